@@ -0,0 +1,77 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+/**
+ * @file
+ * Lariat Allocation Counter Implementation
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ *
+ * This interposes malloc, calloc, and realloc so that EXPECT_ALLOCS_LE and
+ * ASSERT_ALLOCS_LE can count the allocations of the calling thread. It is
+ * deliberately not part of the Lariat library: a unit test program that
+ * wants to count allocations links allocs.o explicitly, and one that does
+ * not (for example because it is built with a sanitizer that interposes the
+ * allocator itself) leaves it out, in which case those assertions report
+ * that allocations cannot be measured.
+ */
+
+#include <stdint.h>
+#include <cstdlib>
+
+/**
+ * The calling thread counts its allocations only while it is being measured.
+ */
+static __thread bool counting = false;
+
+static __thread uint64_t allocations = 0;
+
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t count, size_t size);
+extern "C" void * __libc_realloc(void * pointer, size_t size);
+
+extern "C" void * malloc(size_t size) __THROW
+{
+    if (counting) { ++allocations; }
+    return __libc_malloc(size);
+}
+
+extern "C" void * calloc(size_t count, size_t size) __THROW
+{
+    if (counting) { ++allocations; }
+    return __libc_calloc(count, size);
+}
+
+extern "C" void * realloc(void * pointer, size_t size) __THROW
+{
+    if (counting) { ++allocations; }
+    return __libc_realloc(pointer, size);
+}
+
+namespace com {
+namespace diag {
+namespace lariat {
+
+/**
+ * Start counting the allocations of the calling thread. Probe refers to this
+ * weakly so that it can tell whether allocs.o was linked.
+ */
+void allocsstart()
+{
+    allocations = 0;
+    counting = true;
+}
+
+/**
+ * Stop counting the allocations of the calling thread.
+ * @return the number of allocations since allocsstart().
+ */
+uint64_t allocsstop()
+{
+    counting = false;
+    return allocations;
+}
+
+}
+}
+}
@@ -0,0 +1,152 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+/**
+ * @file
+ * Lariat A/B Comparison Statistics Implementation
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ */
+
+#include <stdint.h>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "com/diag/lariat/compare.h"
+
+using namespace std;
+
+namespace com {
+namespace diag {
+namespace lariat {
+
+/**
+ * Return the standard normal deviate exceeded in either direction with the
+ * specified probability.
+ * @param probability is the two-sided tail probability.
+ * @return the deviate.
+ */
+static double deviate(double probability)
+{
+    double low = 0.0;
+    double high = 40.0;
+
+    for (int ii = 0; ii < 100; ++ii) {
+        double middle = (low + high) / 2.0;
+        if (erfc(middle / sqrt(2.0)) > probability) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    return (low + high) / 2.0;
+}
+
+/**
+ * Return the two-sided Mann-Whitney U p-value, using the normal approximation
+ * with corrections for ties and continuity.
+ * @param a points to the timings of A.
+ * @param na is the number of timings of A.
+ * @param b points to the timings of B.
+ * @param nb is the number of timings of B.
+ * @return the p-value.
+ */
+static double mannwhitney(const uint64_t * a, unsigned int na, const uint64_t * b, unsigned int nb)
+{
+    vector< pair<uint64_t, int> > pooled;
+    pooled.reserve(na + nb);
+    for (unsigned int ii = 0; ii < na; ++ii) {
+        pooled.push_back(make_pair(a[ii], 0));
+    }
+    for (unsigned int ii = 0; ii < nb; ++ii) {
+        pooled.push_back(make_pair(b[ii], 1));
+    }
+    sort(pooled.begin(), pooled.end());
+
+    double n = na + nb;
+    double ranks = 0.0;
+    double ties = 0.0;
+
+    for (size_t ii = 0; ii < pooled.size(); ) {
+        size_t jj = ii;
+        while ((jj < pooled.size()) && (pooled[jj].first == pooled[ii].first)) {
+            ++jj;
+        }
+        double rank = ((ii + 1) + jj) / 2.0;
+        double tied = jj - ii;
+        ties += (tied * tied * tied) - tied;
+        for (size_t kk = ii; kk < jj; ++kk) {
+            if (pooled[kk].second == 0) {
+                ranks += rank;
+            }
+        }
+        ii = jj;
+    }
+
+    double u = ranks - ((na * (na + 1.0)) / 2.0);
+    double mean = (na * (double)nb) / 2.0;
+    double variance = ((na * (double)nb) / 12.0) * ((n + 1.0) - (ties / (n * (n - 1.0))));
+
+    if (variance <= 0.0) {
+        return 1.0;
+    }
+
+    double distance = fabs(u - mean) - 0.5;
+    if (distance < 0.0) {
+        distance = 0.0;
+    }
+
+    return erfc((distance / sqrt(variance)) / sqrt(2.0));
+}
+
+int compare(const uint64_t * a, unsigned int na, const uint64_t * b, unsigned int nb, Comparison * comparisonp, double confidence)
+{
+    if ((na < 2) || (nb < 2)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    vector<double> ratios;
+    ratios.reserve(na * nb);
+    for (unsigned int ii = 0; ii < na; ++ii) {
+        for (unsigned int jj = 0; jj < nb; ++jj) {
+            double numerator = (a[ii] > 0) ? a[ii] : 1;
+            double denominator = (b[jj] > 0) ? b[jj] : 1;
+            ratios.push_back(log(numerator / denominator));
+        }
+    }
+    sort(ratios.begin(), ratios.end());
+
+    size_t count = ratios.size();
+    double median = (count % 2) ? ratios[count / 2] : ((ratios[(count / 2) - 1] + ratios[count / 2]) / 2.0);
+
+    // The interval runs from the Cth smallest to the Cth largest ratio, where
+    // C is one more than the largest U that the Mann-Whitney test rejects
+    // (Hollander and Wolfe), here from the normal approximation to U.
+    double z = deviate(1.0 - confidence);
+    double spread = z * sqrt((na * (double)nb * (na + nb + 1.0)) / 12.0);
+    double critical = floor((count / 2.0) - spread);
+    size_t c = (critical > 1.0) ? (size_t)critical : 1;
+    if (c > (count + 1) / 2) {
+        c = (count + 1) / 2;
+    }
+
+    Comparison comparison;
+    comparison.speedup = exp(median);
+    comparison.lower = exp(ratios[c - 1]);
+    comparison.upper = exp(ratios[count - c]);
+    comparison.p = mannwhitney(a, na, b, nb);
+
+    if (comparisonp != 0) {
+        *comparisonp = comparison;
+    }
+
+    return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,49 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+#ifndef COM_DIAG_LARIAT_COMPARE_H_
+#define COM_DIAG_LARIAT_COMPARE_H_
+
+/**
+ * @file
+ * Lariat A/B Comparison Statistics Declaration
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ *
+ * These compare two sets of timings without assuming that either is normally
+ * distributed, which timings on a real host rarely are. The Mann-Whitney U
+ * test decides whether one set tends to be larger than the other, and the
+ * Hodges-Lehmann estimator (the median of all pairwise ratios) and its
+ * distribution-free confidence interval say by how much.
+ */
+
+#include <stdint.h>
+
+namespace com { namespace diag { namespace lariat {
+
+/**
+ * This is what the comparison of two sets of timings looks like.
+ */
+struct Comparison {
+    double speedup;     //!< Estimated ratio of A to B; above one means B is faster.
+    double lower;       //!< Lower bound of the confidence interval of the speedup.
+    double upper;       //!< Upper bound of the confidence interval of the speedup.
+    double p;           //!< Two-sided Mann-Whitney U p-value.
+};
+
+/**
+ * Compare two sets of timings.
+ *
+ * @param a points to the timings of A.
+ * @param na is the number of timings of A.
+ * @param b points to the timings of B.
+ * @param nb is the number of timings of B.
+ * @param comparisonp points to where the comparison is returned.
+ * @param confidence is the confidence level of the interval.
+ * @return 0 for success, <0 if either set has fewer than two timings.
+ */
+extern int compare(const uint64_t * a, unsigned int na, const uint64_t * b, unsigned int nb, Comparison * comparisonp, double confidence = 0.95);
+
+} } }
+
+#endif /* COM_DIAG_LARIAT_COMPARE_H_ */
@@ -0,0 +1,147 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+#ifndef COM_DIAG_LARIAT_METRICS_H_
+#define COM_DIAG_LARIAT_METRICS_H_
+
+/**
+ * @file
+ * Lariat Test Metrics Declaration
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ *
+ * Metrics are named histograms and counters that unit tests can update from
+ * any thread. Each thread updates its own shard of every metric without
+ * locks, and the shards are merged (and reset) at the end of each test,
+ * when the surrogate main program reports the count, 50th, 99th, and 99.9th
+ * percentiles, and maximum of each histogram, and the total of each counter,
+ * both to standard output and as Google Test properties of the test named
+ * "metric." followed by the name of the metric.
+ *
+ * The first time a thread looks up a metric it claims its shard, which may
+ * allocate memory and take a lock; registering a new metric does both too.
+ * LARIAT_RECORD and LARIAT_COUNTER look the name up the first time each
+ * thread executes them, so it is that first execution in each thread that
+ * pays. A thread that must not can call metric() ahead of time. After that,
+ * recording a value or counting an event neither allocates nor locks.
+ *
+ * Histograms are log-linear, in the style of HDR histograms: values less
+ * than sixty-four are counted exactly, and larger values within about three
+ * percent. Percentiles are reported as the largest value of their bucket.
+ */
+
+#include <stdint.h>
+
+namespace com { namespace diag { namespace lariat {
+
+/**
+ * This is the maximum number of distinct metric names.
+ */
+static const unsigned int METRICS = 64;
+
+/**
+ * This is what a merged metric looks like.
+ */
+struct Summary {
+    const char * name;      //!< Name of the metric.
+    bool counter;           //!< True for a counter, false for a histogram.
+    uint64_t count;         //!< Number of values recorded, or counter total.
+    uint64_t p50;           //!< 50th percentile.
+    uint64_t p99;           //!< 99th percentile.
+    uint64_t p999;          //!< 99.9th percentile.
+    uint64_t maximum;       //!< Largest value recorded.
+};
+
+/**
+ * Begin recording metrics. Until this is called, and after metricsclose() is
+ * called, recording a value or counting an event does nothing.
+ *
+ * @return 0 for success, <0 otherwise.
+ */
+extern int metricsopen();
+
+/**
+ * Stop recording metrics. Shard storage is retained until the process exits
+ * so that a thread that outlives the unit tests never touches freed memory.
+ *
+ * @return 0 for success, <0 otherwise.
+ */
+extern int metricsclose();
+
+/**
+ * Look up the named metric, registering it if it is new.
+ *
+ * @param name points to the name of the metric, which is copied.
+ * @param counter is true for a counter, false for a histogram.
+ * @return the index of the metric, <0 if there are already METRICS names.
+ */
+extern int metric(const char * name, bool counter = false);
+
+/**
+ * Return the number of metrics that have been registered.
+ *
+ * @return the number of metrics.
+ */
+extern unsigned int metrics();
+
+/**
+ * Record a value in the calling thread's shard of a histogram. If the thread
+ * has not yet looked up any metric, this claims its shard first.
+ *
+ * @param index is the index of the metric; if <0 nothing is recorded.
+ * @param value is the value.
+ */
+extern void record(int index, uint64_t value);
+
+/**
+ * Increment the calling thread's shard of a counter. If the thread has not
+ * yet looked up any metric, this claims its shard first.
+ *
+ * @param index is the index of the metric; if <0 nothing is counted.
+ */
+extern void count(int index);
+
+/**
+ * Merge and reset all shards of a metric.
+ *
+ * @param index is the index of the metric.
+ * @param summaryp points to where the merged summary is returned.
+ * @return 1 if anything was recorded, 0 if not, <0 for an invalid index.
+ */
+extern int metricsmerge(int index, Summary * summaryp);
+
+} } }
+
+/**
+ * @def LARIAT_RECORD
+ * Record @a _VALUE_ in the histogram named @a _NAME_. The name is looked up
+ * only the first time each thread executes the call site.
+ */
+#define LARIAT_RECORD(_NAME_, _VALUE_) \
+    do { \
+        static __thread bool lariat_looked_ = false; \
+        static __thread int lariat_metric_ = -1; \
+        if (!lariat_looked_) { \
+            lariat_metric_ = ::com::diag::lariat::metric(_NAME_, false); \
+            lariat_looked_ = true; \
+        } \
+        ::com::diag::lariat::record(lariat_metric_, (_VALUE_)); \
+    } while (0)
+
+/**
+ * @def LARIAT_COUNTER
+ * Increment the counter named @a _NAME_. The name is looked up only the first
+ * time each thread executes the call site.
+ */
+#define LARIAT_COUNTER(_NAME_) \
+    do { \
+        static __thread bool lariat_looked_ = false; \
+        static __thread int lariat_metric_ = -1; \
+        if (!lariat_looked_) { \
+            lariat_metric_ = ::com::diag::lariat::metric(_NAME_, true); \
+            lariat_looked_ = true; \
+        } \
+        ::com::diag::lariat::count(lariat_metric_); \
+    } while (0)
+
+#endif /* COM_DIAG_LARIAT_METRICS_H_ */
@@ -0,0 +1,205 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+#ifndef COM_DIAG_LARIAT_PERFORMANCE_H_
+#define COM_DIAG_LARIAT_PERFORMANCE_H_
+
+/**
+ * @file
+ * Lariat Performance Assertions Declaration
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ *
+ * These assertions check what a statement costs as well as what it does.
+ * Each runs the statement once to warm up and then COM_DIAG_LARIAT_REPETITIONS
+ * more times in the calling thread, 1 + COM_DIAG_LARIAT_REPETITIONS times in
+ * all, inside the same process and resource limits as the rest of the test,
+ * measuring each repetition, subtracting the cost of the measurement itself,
+ * and comparing a statistic against the bound. For times and instructions
+ * that is the median, which unlike the mean is not dragged upwards by the odd
+ * repetition that is interrupted or preempted. For allocations and system
+ * calls, which are exact counts, it is the maximum, so that a statement that
+ * allocates on only some repetitions still fails. When an assertion fails it
+ * reports the statistic it compared first, and then the rest of the measured
+ * distribution.
+ *
+ *  EXPECT_WALLTIME_LE(statement, bound)     CLOCK_MONOTONIC nanoseconds
+ *  EXPECT_CPU_LE(statement, bound)          thread CPU nanoseconds
+ *  EXPECT_ALLOCS_LE(statement, bound)       calls to malloc, calloc, realloc
+ *  EXPECT_SYSCALLS_LE(statement, bound)     system calls entered
+ *  EXPECT_INSTRUCTIONS_LE(statement, bound) user mode instructions retired
+ *
+ * Time bounds may be std::chrono durations (e.g. 2ms) or nanoseconds. Each
+ * has an ASSERT_ form. Only the calling thread is measured. Counting
+ * allocations requires linking allocs.o, which is not in the library and
+ * which interposes malloc, calloc, and realloc; aligned allocations are not
+ * counted. System calls and instructions are counted with perf events. An
+ * assertion whose cost cannot be measured on this host still runs the
+ * statement, but only once, and does not fail; it records a test property
+ * named "lariat.unavailable." followed by the meter and, with a Google Test
+ * that supports skipping, marks the test skipped.
+ */
+
+#include <stdint.h>
+#include <chrono>
+#include "gtest/gtest.h"
+
+#if !defined(COM_DIAG_LARIAT_REPETITIONS)
+#   define COM_DIAG_LARIAT_REPETITIONS 31
+#endif
+
+namespace com { namespace diag { namespace lariat {
+
+/**
+ * These are the costs that can be measured.
+ */
+enum Meter {
+    WALLTIME,
+    CPUTIME,
+    ALLOCS,
+    SYSCALLS,
+    INSTRUCTIONS,
+};
+
+/**
+ * A Probe measures one kind of cost of the calling thread between start()
+ * and stop().
+ */
+class Probe {
+
+public:
+
+    explicit Probe(Meter meter);
+
+    ~Probe();
+
+    /**
+     * Return the kind of cost this probe measures.
+     * @return the meter.
+     */
+    Meter meter() const { return kind; }
+
+    /**
+     * Return true if this kind of cost can be measured on this host.
+     * @return true if available, false otherwise.
+     */
+    bool available() const { return usable; }
+
+    /**
+     * Return the cost of measuring nothing, which is subtracted from samples.
+     * @return the overhead.
+     */
+    uint64_t overhead() const { return baseline; }
+
+    void start();
+
+    uint64_t stop();
+
+private:
+
+    Meter kind;
+
+    int fd;
+
+    bool usable;
+
+    uint64_t baseline;
+
+    uint64_t before;
+
+    Probe(const Probe &);
+
+    Probe & operator=(const Probe &);
+
+};
+
+/**
+ * Compare the median of the samples, or their maximum for allocations and
+ * system calls, against the bound and describe the distribution if it
+ * exceeds it. The samples are sorted in place.
+ *
+ * @param probe refers to the probe that took the samples.
+ * @param samples points to the samples.
+ * @param count is the number of samples.
+ * @param statement is the text of the statement.
+ * @param bound is the bound.
+ * @param text is the text of the bound.
+ * @param file is the source file of the assertion.
+ * @param line is the source line of the assertion.
+ * @return the assertion result.
+ */
+extern ::testing::AssertionResult assess(const Probe & probe, uint64_t * samples, unsigned int count, const char * statement, uint64_t bound, const char * text, const char * file, int line);
+
+/**
+ * Run and measure a statement.
+ *
+ * @param meter is the kind of cost measured.
+ * @param statement is a functor that runs the statement.
+ * @param text is the text of the statement.
+ * @param bound is the bound.
+ * @param limit is the text of the bound.
+ * @param file is the source file of the assertion.
+ * @param line is the source line of the assertion.
+ * @return the assertion result.
+ */
+template <typename _FUNCTOR_>
+::testing::AssertionResult measure(Meter meter, _FUNCTOR_ statement, const char * text, uint64_t bound, const char * limit, const char * file, int line)
+{
+    uint64_t samples[COM_DIAG_LARIAT_REPETITIONS];
+    Probe probe(meter);
+
+    // The statement always runs at least once, so that its effects do not
+    // depend on whether the host can measure it.
+    statement();
+
+    if (probe.available()) {
+        for (unsigned int ii = 0; ii < COM_DIAG_LARIAT_REPETITIONS; ++ii) {
+            probe.start();
+            statement();
+            samples[ii] = probe.stop();
+        }
+    }
+
+    return assess(probe, samples, COM_DIAG_LARIAT_REPETITIONS, text, bound, limit, file, line);
+}
+
+/**
+ * Convert a count or a time in nanoseconds into a bound.
+ * @param value is the count or nanoseconds.
+ * @return the bound.
+ */
+inline uint64_t boundof(unsigned long long value) {
+    return value;
+}
+
+/**
+ * Convert a std::chrono duration into a bound in nanoseconds.
+ * @param value is the duration.
+ * @return the bound.
+ */
+template <typename _REP_, typename _PERIOD_>
+inline uint64_t boundof(const std::chrono::duration<_REP_, _PERIOD_> & value) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(value).count();
+}
+
+} } }
+
+#define LARIAT_PERFORMANCE_(_METER_, _STATEMENT_, _BOUND_, _ON_FAILURE_) \
+    GTEST_ASSERT_(::com::diag::lariat::measure(::com::diag::lariat::_METER_, [&]() { _STATEMENT_; }, #_STATEMENT_, ::com::diag::lariat::boundof(_BOUND_), #_BOUND_, __FILE__, __LINE__), _ON_FAILURE_)
+
+#define EXPECT_WALLTIME_LE(_STATEMENT_, _BOUND_) LARIAT_PERFORMANCE_(WALLTIME, _STATEMENT_, _BOUND_, GTEST_NONFATAL_FAILURE_)
+#define ASSERT_WALLTIME_LE(_STATEMENT_, _BOUND_) LARIAT_PERFORMANCE_(WALLTIME, _STATEMENT_, _BOUND_, GTEST_FATAL_FAILURE_)
+
+#define EXPECT_CPU_LE(_STATEMENT_, _BOUND_) LARIAT_PERFORMANCE_(CPUTIME, _STATEMENT_, _BOUND_, GTEST_NONFATAL_FAILURE_)
+#define ASSERT_CPU_LE(_STATEMENT_, _BOUND_) LARIAT_PERFORMANCE_(CPUTIME, _STATEMENT_, _BOUND_, GTEST_FATAL_FAILURE_)
+
+#define EXPECT_ALLOCS_LE(_STATEMENT_, _BOUND_) LARIAT_PERFORMANCE_(ALLOCS, _STATEMENT_, _BOUND_, GTEST_NONFATAL_FAILURE_)
+#define ASSERT_ALLOCS_LE(_STATEMENT_, _BOUND_) LARIAT_PERFORMANCE_(ALLOCS, _STATEMENT_, _BOUND_, GTEST_FATAL_FAILURE_)
+
+#define EXPECT_SYSCALLS_LE(_STATEMENT_, _BOUND_) LARIAT_PERFORMANCE_(SYSCALLS, _STATEMENT_, _BOUND_, GTEST_NONFATAL_FAILURE_)
+#define ASSERT_SYSCALLS_LE(_STATEMENT_, _BOUND_) LARIAT_PERFORMANCE_(SYSCALLS, _STATEMENT_, _BOUND_, GTEST_FATAL_FAILURE_)
+
+#define EXPECT_INSTRUCTIONS_LE(_STATEMENT_, _BOUND_) LARIAT_PERFORMANCE_(INSTRUCTIONS, _STATEMENT_, _BOUND_, GTEST_NONFATAL_FAILURE_)
+#define ASSERT_INSTRUCTIONS_LE(_STATEMENT_, _BOUND_) LARIAT_PERFORMANCE_(INSTRUCTIONS, _STATEMENT_, _BOUND_, GTEST_FATAL_FAILURE_)
+
+#endif /* COM_DIAG_LARIAT_PERFORMANCE_H_ */
@@ -0,0 +1,114 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+#ifndef COM_DIAG_LARIAT_STATUS_H_
+#define COM_DIAG_LARIAT_STATUS_H_
+
+/**
+ * @file
+ * Lariat Live Status Page Declaration
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ *
+ * The status page is a POSIX shared memory object, one per unit test process,
+ * that the surrogate main program updates as each test starts and ends, and
+ * that monitors such as lariat-top map read-only. The writer never blocks:
+ * it brackets each update by incrementing a sequence number, and a reader
+ * retries if the sequence number was odd or changed while it was copying.
+ * All times are CLOCK_MONOTONIC nanoseconds, which are comparable across
+ * processes on the same host.
+ */
+
+#include <stdint.h>
+
+namespace com { namespace diag { namespace lariat {
+
+/**
+ * This prefixes the name of every status page in the shared memory name space.
+ * The process identifier of the writer follows it.
+ */
+static const char STATUS_PREFIX[] = "com-diag-lariat-";
+
+/**
+ * This is what a status page looks like.
+ */
+struct Status {
+    char magic[8];                  //!< Identifies a status page.
+    uint32_t version;               //!< Identifies the layout.
+    int32_t pid;                    //!< Process identifier of the writer.
+    volatile uint32_t sequence;     //!< Odd while an update is in progress.
+    volatile uint32_t finished;     //!< Non-zero once all tests have run.
+    volatile uint32_t total;        //!< Number of tests to run.
+    volatile uint32_t completed;    //!< Number of tests that have ended.
+    volatile uint32_t passed;       //!< Number of tests that passed.
+    volatile uint32_t failed;       //!< Number of tests that failed.
+    volatile uint64_t begun;        //!< When the first test started.
+    volatile uint64_t started;      //!< When the current test started.
+    volatile uint64_t updated;      //!< When the page was last updated.
+    volatile uint64_t deadline;     //!< When the real time timer expires or zero.
+    volatile uint64_t user;         //!< User CPU time in microseconds.
+    volatile uint64_t system;       //!< System CPU time in microseconds.
+    volatile uint64_t resident;     //!< Maximum resident set size in kilobytes.
+    volatile uint64_t minor;        //!< Minor page faults.
+    volatile uint64_t major;        //!< Major page faults.
+    volatile uint64_t voluntary;    //!< Voluntary context switches.
+    volatile uint64_t involuntary;  //!< Involuntary context switches.
+    char program[64];               //!< Name of the program.
+    char test[192];                 //!< Name of the current test or empty.
+};
+
+/**
+ * Create the status page of this process. The page, and its name, are
+ * removed by statusclose(). Forked children never write into the page of
+ * their parent.
+ *
+ * @param program points to the name of the program.
+ * @param total is the number of tests that will be run.
+ * @return 0 for success, <0 otherwise.
+ */
+extern int statusopen(const char * program, unsigned int total);
+
+/**
+ * Note in the status page that a test has started. This also refreshes the
+ * resource usage and real time timer deadline. This does nothing if no
+ * status page is open.
+ *
+ * @param test points to the name of the test.
+ */
+extern void statusstart(const char * test);
+
+/**
+ * Note in the status page that the current test has ended. This also
+ * refreshes the resource usage and real time timer deadline. This does
+ * nothing if no status page is open.
+ *
+ * @param passed is true if the test passed, false otherwise.
+ */
+extern void statusend(bool passed);
+
+/**
+ * Mark the status page finished, unmap it, and remove its name.
+ *
+ * @return 0 for success, <0 otherwise.
+ */
+extern int statusclose();
+
+/**
+ * Take a consistent snapshot of a status page.
+ *
+ * @param name points to the name of the page, with or without a leading slash.
+ * @param statusp points to where the snapshot is returned.
+ * @return 0 for success, <0 otherwise.
+ */
+extern int statusread(const char * name, Status * statusp);
+
+/**
+ * Return the current CLOCK_MONOTONIC time.
+ *
+ * @return the time in nanoseconds.
+ */
+extern uint64_t monotonic();
+
+} } }
+
+#endif /* COM_DIAG_LARIAT_STATUS_H_ */
@@ -0,0 +1,160 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+#ifndef COM_DIAG_LARIAT_TRACE_H_
+#define COM_DIAG_LARIAT_TRACE_H_
+
+/**
+ * @file
+ * Lariat Timeline Trace Declaration
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ *
+ * The timeline trace is a memory mapped file containing a fixed number of
+ * fixed size ring buffers, one per thread (or per forked process), each of
+ * which records time stamped begin, end, and instant events. Each thread
+ * claims its own ring the first time it records an event, so recording an
+ * event takes no locks and makes no system calls beyond reading the
+ * monotonic clock. Rings are never released, so each forked death test uses
+ * one up for good. If all rings have been claimed, the events of any
+ * additional threads are dropped, and reading the trace reports how many
+ * threads lost them. The trace file survives the
+ * process being killed, and can be converted to Chrome trace JSON (readable
+ * by chrome://tracing or Perfetto) afterwards.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+namespace com { namespace diag { namespace lariat {
+
+/**
+ * This is the default number of per-thread rings in a trace file.
+ */
+static const unsigned int TRACE_THREADS = 128;
+
+/**
+ * This is the default number of events in each per-thread ring.
+ */
+static const unsigned int TRACE_EVENTS = 4096;
+
+/**
+ * This is the size of the name field in each event including the terminating
+ * NUL. Longer names are truncated.
+ */
+static const unsigned int TRACE_NAME = 48;
+
+/**
+ * These are the phases of the begin and end events that the surrogate main
+ * program records for each test, so that tools can tell the spans of tests
+ * from the spans that tests and their fixtures record themselves. They are
+ * converted to 'B' and 'E' in Chrome trace JSON.
+ */
+static const char TRACE_TEST_BEGIN = 'T';
+static const char TRACE_TEST_END = 't';
+
+/**
+ * Create and map the specified trace file and begin recording events into it.
+ * If the process is the product of an exec by a process that was already
+ * tracing to the same file (as is the case with "threadsafe" death tests),
+ * the existing trace file is instead reattached without being truncated.
+ *
+ * @param path is the path name of the trace file.
+ * @param threads is the number of per-thread rings.
+ * @param events is the number of events in each ring.
+ * @return 0 for success, <0 otherwise.
+ */
+extern int traceopen(const char * path, unsigned int threads = TRACE_THREADS, unsigned int events = TRACE_EVENTS);
+
+/**
+ * Return the path name of the trace file being recorded.
+ *
+ * @return the path name, or null if no trace file is open.
+ */
+extern const char * tracepath();
+
+/**
+ * Stop recording events and unmap the trace file.
+ *
+ * @return 0 for success, <0 otherwise.
+ */
+extern int traceclose();
+
+/**
+ * Record an event in the ring of the calling thread stamped with the current
+ * CLOCK_MONOTONIC time. This does nothing if no trace file is open.
+ *
+ * @param phase is 'B' for begin, 'E' for end, 'i' for an instant, or
+ * TRACE_TEST_BEGIN or TRACE_TEST_END for the begin or end of a test.
+ * @param name points to the name of the event.
+ */
+extern void tracepoint(char phase, const char * name);
+
+/**
+ * This is the type of a function that is called for each event in a trace
+ * file. Events of each thread are visited in the order they were recorded.
+ */
+typedef void (* TraceVisitor)(void * context, int pid, int tid, char phase, uint64_t nanoseconds, const char * name);
+
+/**
+ * Call the visitor for every event in the specified trace file. A thread
+ * that recorded more events than its ring holds has lost the oldest of them,
+ * and threads that came after every ring was claimed recorded nothing; both
+ * are noted on standard error.
+ *
+ * @param path is the path name of the trace file.
+ * @param visitor points to the visitor function.
+ * @param context is passed to the visitor function.
+ * @return the number of events visited, <0 for failure.
+ */
+extern int tracevisit(const char * path, TraceVisitor visitor, void * context);
+
+/**
+ * Convert the specified trace file into Chrome trace JSON.
+ *
+ * @param path is the path name of the trace file.
+ * @param stream points to an output stream to which the JSON is printed.
+ * @return the number of events converted, <0 for failure.
+ */
+extern int tracechrome(const char * path, FILE * stream);
+
+/**
+ * A Scope records a begin event when it is constructed and a matching end
+ * event when it is destroyed.
+ */
+class Scope {
+
+public:
+
+    explicit Scope(const char * name)
+    : label(name)
+    {
+        tracepoint('B', label);
+    }
+
+    ~Scope() {
+        tracepoint('E', label);
+    }
+
+private:
+
+    const char * label;
+
+    Scope(const Scope &);
+
+    Scope & operator=(const Scope &);
+
+};
+
+} } }
+
+#define LARIAT_TRACE_SCOPE_CAT_(_A_, _B_) _A_ ## _B_
+#define LARIAT_TRACE_SCOPE_VAR_(_LINE_) LARIAT_TRACE_SCOPE_CAT_(lariat_trace_scope_, _LINE_)
+
+/**
+ * @def LARIAT_TRACE_SCOPE
+ * Record a span named @a _NAME_ from here to the end of the enclosing scope.
+ */
+#define LARIAT_TRACE_SCOPE(_NAME_) ::com::diag::lariat::Scope LARIAT_TRACE_SCOPE_VAR_(__LINE__)(_NAME_)
+
+#endif /* COM_DIAG_LARIAT_TRACE_H_ */
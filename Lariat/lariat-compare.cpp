@@ -0,0 +1,455 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+/**
+ * @file
+ * Lariat A/B Performance Comparison Driver
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ *
+ * usage: lariat-compare [ -n ROUNDS ] [ -w WARMUPS ] [ -c CPU ] [ -a ALPHA ]
+ *                       [ -s SEED ] [ -v ] [ -? ] A B [ ARGUMENTS ... ]
+ *
+ * Runs two builds, A and B, of the same unit test program alternately in
+ * rounds, in a random order within each round, pinned to the same CPU, and
+ * with the same ARGUMENTS, which should include any Lariat resource limits
+ * and Google Test filter. Both builds must use the Lariat surrogate main
+ * program: each run records a timeline trace from which the real time of
+ * every test is taken with nanosecond resolution. Then for every test, and
+ * for the program as a whole, it prints the median times, the speedup of B
+ * over A with its confidence interval, and the Mann-Whitney U p-value, both
+ * corrected for the number of tests compared so that a suite compared against
+ * itself has only an ALPHA chance of any spurious difference at all.
+ * A test that only one build ran is reported as missing, and one with fewer
+ * than two times from either build as insufficient, with its sample counts.
+ * Tests are matched between A and B by the names in their traces; a name too
+ * long for a trace event ends in a hash of the whole name instead.
+ * Interleaving the runs spreads drift in the host (thermal throttling, other
+ * tenants, cache and page cache state) evenly across A and B instead of
+ * letting it masquerade as a difference between them.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include "com/diag/lariat/lariat.h"
+#include "com/diag/lariat/trace.h"
+#include "com/diag/lariat/status.h"
+#include "com/diag/lariat/compare.h"
+
+using namespace std;
+using namespace ::com::diag::lariat;
+
+extern char * optarg;
+extern int optind;
+
+/**
+ * This names the pseudo-test that is the whole program.
+ */
+static const char PROGRAM[] = "(program)";
+
+typedef map< string, vector<uint64_t> > Samples;
+
+/**
+ * This is the state of extracting test times from one trace.
+ */
+struct Extraction {
+    int pid;
+    uint64_t began;
+    char name[TRACE_NAME];
+    Samples * samples;
+};
+
+/**
+ * Record the time of each test, which is the span between the test begin and
+ * end events that the surrogate main program records in the main thread of
+ * the program itself. Other spans, and those of forked death tests and other
+ * threads, are ignored, as is an end without its begin (which a ring that
+ * wrapped may have lost). This is a TraceVisitor.
+ */
+static void extract(void * context, int pid, int tid, char phase, uint64_t nanoseconds, const char * name)
+{
+    Extraction * state = static_cast<Extraction *>(context);
+
+    if ((pid != state->pid) || (tid != state->pid)) {
+        return;
+    }
+
+    if (phase == TRACE_TEST_BEGIN) {
+        state->began = nanoseconds;
+        strncpy(state->name, name, sizeof(state->name) - 1);
+        state->name[sizeof(state->name) - 1] = '\0';
+    } else if (phase == TRACE_TEST_END) {
+        if ((state->began != 0) && (strcmp(state->name, name) == 0)) {
+            (*state->samples)[name].push_back(nanoseconds - state->began);
+        }
+        state->began = 0;
+    } else {
+        // Do nothing.
+    }
+}
+
+/**
+ * Run one build pinned to a CPU and collect its test times.
+ * @param binary is the path of the build.
+ * @param arguments are the arguments common to both builds.
+ * @param cpu is the CPU to which the build is pinned.
+ * @param trace is the path of the trace file.
+ * @param verbose if true lets the build write to standard output and error.
+ * @param samplesp points to where the test times are added, or null to discard them.
+ * @return 0 for success, <0 otherwise.
+ */
+static int run(const char * binary, const vector<char *> & arguments, int cpu, const char * trace, bool verbose, Samples * samplesp)
+{
+    vector<char *> argv;
+    argv.push_back(const_cast<char *>(binary));
+    argv.push_back(const_cast<char *>("-x"));
+    argv.push_back(const_cast<char *>(trace));
+    argv.insert(argv.end(), arguments.begin(), arguments.end());
+    argv.push_back(0);
+
+    uint64_t before = monotonic();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+            perror("sched_setaffinity");
+            _exit(127);
+        }
+        if (!verbose) {
+            int fd = open("/dev/null", O_WRONLY);
+            if (fd >= 0) {
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+                close(fd);
+            }
+        }
+        execv(binary, &(argv[0]));
+        perror(binary);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return -1;
+    }
+
+    uint64_t after = monotonic();
+
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "%s: killed by signal %d\n", binary, WTERMSIG(status));
+        return -1;
+    }
+
+    if (WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s: exited with %d\n", binary, WEXITSTATUS(status));
+        return -1;
+    }
+
+    if (samplesp == 0) {
+        return 0;
+    }
+
+    Extraction state;
+    state.pid = pid;
+    state.began = 0;
+    state.name[0] = '\0';
+    state.samples = samplesp;
+    if (tracevisit(trace, extract, &state) < 0) {
+        return -1;
+    }
+
+    (*samplesp)[PROGRAM].push_back(after - before);
+
+    return 0;
+}
+
+/**
+ * Return the median of a set of times.
+ * @param times refers to the times.
+ * @return the median.
+ */
+static double median(vector<uint64_t> times)
+{
+    sort(times.begin(), times.end());
+    size_t count = times.size();
+    return (count % 2) ? times[count / 2] : ((times[(count / 2) - 1] + times[count / 2]) / 2.0);
+}
+
+/**
+ * Format a time in nanoseconds with a readable unit.
+ * @param nanoseconds is the time.
+ * @param buffer points to the buffer.
+ * @param size is the size of the buffer.
+ * @return the buffer.
+ */
+static const char * readable(double nanoseconds, char * buffer, size_t size)
+{
+    if (nanoseconds >= 1000000000.0) {
+        snprintf(buffer, size, "%.3fs", nanoseconds / 1000000000.0);
+    } else if (nanoseconds >= 1000000.0) {
+        snprintf(buffer, size, "%.3fms", nanoseconds / 1000000.0);
+    } else if (nanoseconds >= 1000.0) {
+        snprintf(buffer, size, "%.3fus", nanoseconds / 1000.0);
+    } else {
+        snprintf(buffer, size, "%.0fns", nanoseconds);
+    }
+    return buffer;
+}
+
+/**
+ * This is the comparison of one test.
+ */
+struct Row {
+    const char * name;
+    const vector<uint64_t> * a;
+    const vector<uint64_t> * b;
+    Comparison comparison;
+    double adjusted;
+    bool judged;
+};
+
+/**
+ * Order comparisons by increasing unadjusted p-value.
+ */
+static bool ascending(const Row * one, const Row * two)
+{
+    return one->comparison.p < two->comparison.p;
+}
+
+static void usage(const char * program, FILE * stream)
+{
+    fprintf(stream, "\n");
+    fprintf(stream, "usage: %s [ -n ROUNDS ] [ -w WARMUPS ] [ -c CPU ] [ -a ALPHA ] [ -s SEED ] [ -v ] [ -? ] A B [ ARGUMENTS ... ]\n", program);
+    fprintf(stream, "       -n ROUNDS     Measure ROUNDS interleaved runs of each build (default 20)\n");
+    fprintf(stream, "       -w WARMUPS    Discard WARMUPS runs of each build first (default 1)\n");
+    fprintf(stream, "       -c CPU        Pin both builds to CPU (default the current CPU)\n");
+    fprintf(stream, "       -a ALPHA      Report differences significant at ALPHA across all tests (default 0.05)\n");
+    fprintf(stream, "       -s SEED       Seed the order of the runs within each round\n");
+    fprintf(stream, "       -v            Show the output of the builds\n");
+    fprintf(stream, "       -?            Print menu\n");
+    fprintf(stream, "       A B           The builds to compare\n");
+    fprintf(stream, "       ARGUMENTS     Lariat and Google Test arguments given to both builds\n");
+}
+
+int main(int argc, char ** argv)
+{
+    const char * program = strrchr(argv[0], '/');
+    program = (program == (char *)0) ? argv[0] : program + 1;
+
+    int opt;
+    bool error = false;
+    bool verbose = false;
+    unsigned long rounds = 20;
+    unsigned long warmups = 1;
+    unsigned long value;
+    int cpu = sched_getcpu();
+    double alpha = 0.05;
+    unsigned int seed = time(0) ^ getpid();
+    char * end;
+    while ((opt = getopt(argc, argv, "+n:w:c:a:s:v?")) >= 0) {
+
+        switch (opt) {
+
+        case 'n':
+            error = (*number(optarg, &rounds) != '\0') || (rounds < 2);
+            break;
+
+        case 'w':
+            error = (*number(optarg, &warmups) != '\0');
+            break;
+
+        case 'c':
+            error = (*number(optarg, &value) != '\0');
+            cpu = value;
+            break;
+
+        case 'a':
+            alpha = strtod(optarg, &end);
+            error = (*end != '\0') || (alpha <= 0.0) || (alpha >= 1.0);
+            break;
+
+        case 's':
+            error = (*number(optarg, &value) != '\0');
+            seed = value;
+            break;
+
+        case 'v':
+            verbose = true;
+            break;
+
+        case '?':
+            usage(program, stderr);
+            return 0;
+
+        default:
+            error = true;
+            break;
+
+        }
+
+        if (error) {
+            break;
+        }
+
+    }
+
+    if (error || ((argc - optind) < 2)) {
+        usage(program, stderr);
+        return 1;
+    }
+
+    if (cpu < 0) {
+        cpu = 0;
+    }
+
+    const char * binary[2] = { argv[optind], argv[optind + 1] };
+    vector<char *> arguments(&(argv[optind + 2]), &(argv[argc]));
+    if ((!arguments.empty()) && (strcmp(arguments[0], "--") == 0)) {
+        arguments.erase(arguments.begin());
+    }
+
+    char trace[] = "/tmp/lariat-compare-XXXXXX";
+    int fd = mkstemp(trace);
+    if (fd < 0) {
+        perror(trace);
+        return 1;
+    }
+    close(fd);
+
+    fprintf(stderr, "%s: A=%s B=%s rounds=%lu warmups=%lu cpu=%d seed=%u\n", program, binary[0], binary[1], rounds, warmups, cpu, seed);
+
+    Samples samples[2];
+    int rc = 0;
+
+    for (unsigned long round = 0; (rc == 0) && (round < (warmups + rounds)); ++round) {
+        int first = rand_r(&seed) & 1;
+        for (int ii = 0; (rc == 0) && (ii < 2); ++ii) {
+            int which = first ^ ii;
+            rc = run(binary[which], arguments, cpu, trace, verbose, (round < warmups) ? 0 : &(samples[which]));
+        }
+    }
+
+    unlink(trace);
+
+    if (rc < 0) {
+        return 1;
+    }
+
+    // Judging every test at ALPHA would report about one spurious difference
+    // in every 1/ALPHA tests, so the p-values are adjusted with the Holm-
+    // Bonferroni method, which bounds the chance of any spurious verdict
+    // across all the tests at ALPHA, and the intervals are widened to the
+    // matching Bonferroni confidence of 1 - ALPHA/TESTS.
+    // Every test either build ran is reported, so that a test that was added,
+    // renamed, or lost from a trace does not just vanish from the report.
+    set<string> names;
+    for (int ii = 0; ii < 2; ++ii) {
+        for (Samples::const_iterator here = samples[ii].begin(); here != samples[ii].end(); ++here) {
+            names.insert(here->first);
+        }
+    }
+
+    static const vector<uint64_t> NONE;
+    vector<Row> rows;
+    for (set<string>::const_iterator here = names.begin(); here != names.end(); ++here) {
+        Row row;
+        row.name = here->c_str();
+        Samples::const_iterator there;
+        row.a = ((there = samples[0].find(*here)) != samples[0].end()) ? &(there->second) : &NONE;
+        row.b = ((there = samples[1].find(*here)) != samples[1].end()) ? &(there->second) : &NONE;
+        row.comparison.p = 1.0;
+        row.adjusted = 1.0;
+        row.judged = false;
+        rows.push_back(row);
+    }
+
+    vector<Row *> order;
+    for (size_t ii = 0; ii < rows.size(); ++ii) {
+        if ((rows[ii].a->size() >= 2) && (rows[ii].b->size() >= 2)) {
+            order.push_back(&(rows[ii]));
+        }
+    }
+
+    size_t tests = order.size();
+    double confidence = 1.0 - (alpha / ((tests > 0) ? tests : 1));
+
+    for (size_t ii = 0; ii < tests; ++ii) {
+        Row & row = *(order[ii]);
+        row.judged = (compare(&((*row.a)[0]), row.a->size(), &((*row.b)[0]), row.b->size(), &(row.comparison), confidence) == 0);
+    }
+
+    sort(order.begin(), order.end(), ascending);
+    double running = 0.0;
+    for (size_t ii = 0; ii < tests; ++ii) {
+        double adjusted = (tests - ii) * order[ii]->comparison.p;
+        if (adjusted > 1.0) {
+            adjusted = 1.0;
+        }
+        if (adjusted > running) {
+            running = adjusted;
+        }
+        order[ii]->adjusted = running;
+    }
+
+    char heading[32];
+    snprintf(heading, sizeof(heading), "CONFIDENCE(%.4g%%)", confidence * 100.0);
+    printf("%-40s %10s %10s %8s %19s %9s %s\n", "TEST", "A", "B", "SPEEDUP", heading, "P(HOLM)", "VERDICT");
+
+    for (size_t ii = 0; ii < rows.size(); ++ii) {
+        const Row & row = rows[ii];
+        if (!row.judged) {
+            char na[32];
+            char nb[32];
+            snprintf(na, sizeof(na), "n=%zu", row.a->size());
+            snprintf(nb, sizeof(nb), "n=%zu", row.b->size());
+            printf("%-40s %10s %10s %8s %19s %9s %s\n",
+                row.name, na, nb, "-", "-", "-",
+                (row.a->empty() || row.b->empty()) ? "missing" : "insufficient");
+            continue;
+        }
+        const Comparison & comparison = row.comparison;
+        const char * verdict = "same";
+        if (row.adjusted >= alpha) {
+            // Do nothing.
+        } else if (comparison.lower > 1.0) {
+            verdict = "faster";
+        } else if (comparison.upper < 1.0) {
+            verdict = "slower";
+        } else {
+            // Do nothing.
+        }
+        char ta[32];
+        char tb[32];
+        char interval[32];
+        snprintf(interval, sizeof(interval), "[%.3fx,%.3fx]", comparison.lower, comparison.upper);
+        printf("%-40s %10s %10s %7.3fx %19s %9.2g %s\n",
+            row.name,
+            readable(median(*row.a), ta, sizeof(ta)), readable(median(*row.b), tb, sizeof(tb)),
+            comparison.speedup, interval, row.adjusted, verdict);
+    }
+
+    return 0;
+}
@@ -0,0 +1,266 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+/**
+ * @file
+ * Lariat Live Status Monitor
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ *
+ * usage: lariat-top [ -i SECONDS ] [ -1 ] [ -u ] [ -? ]
+ *
+ * Displays the status pages of all unit test programs running under the
+ * Lariat surrogate main program with the -p option. The pages are only ever
+ * read, so monitoring does not perturb the tests. The page records resource
+ * usage only at test boundaries, so for a program that is still running the
+ * USER, SYS, and RSS columns are instead sampled live from its /proc stat
+ * file, which is also only read. Columns marked with an asterisk are as of
+ * the last test boundary, for example because the program has exited.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include "com/diag/lariat/lariat.h"
+#include "com/diag/lariat/status.h"
+
+using namespace ::com::diag::lariat;
+
+extern char * optarg;
+
+/**
+ * This is where Linux exposes the POSIX shared memory name space.
+ */
+static const char SHM_DIR[] = "/dev/shm";
+
+static double seconds(uint64_t nanoseconds)
+{
+    return nanoseconds / 1000000000.0;
+}
+
+/**
+ * Sample the current resource usage of a running process from its /proc stat
+ * file.
+ * @param pid is the process identifier.
+ * @param userp points to where user CPU time in microseconds is returned.
+ * @param systemp points to where system CPU time in microseconds is returned.
+ * @param residentp points to where the resident set size in kilobytes is returned.
+ * @return 0 for success, <0 otherwise.
+ */
+static int sample(pid_t pid, uint64_t * userp, uint64_t * systemp, uint64_t * residentp)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    char buffer[1024];
+    ssize_t size = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (size <= 0) {
+        return -1;
+    }
+    buffer[size] = '\0';
+
+    // The command name is parenthesized and may itself contain spaces and
+    // parentheses, so the remaining fields begin after the last parenthesis.
+    const char * here = strrchr(buffer, ')');
+    if (here == 0) {
+        return -1;
+    }
+
+    unsigned long long utime;
+    unsigned long long stime;
+    long long rss;
+    if (sscanf(here + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %*d %*d %*u %*u %lld", &utime, &stime, &rss) != 3) {
+        return -1;
+    }
+
+    static long ticks = sysconf(_SC_CLK_TCK);
+    static long page = sysconf(_SC_PAGESIZE);
+    if ((ticks <= 0) || (page <= 0)) {
+        return -1;
+    }
+
+    *userp = (utime * 1000000ULL) / ticks;
+    *systemp = (stime * 1000000ULL) / ticks;
+    *residentp = (rss > 0) ? ((rss * page) / 1024) : 0;
+
+    return 0;
+}
+
+/**
+ * Print one line for a status page.
+ * @param status refers to the snapshot of the page.
+ * @param now is the current time.
+ * @param stream points to an output stream to which the line is printed.
+ * @return true if the writer is still alive, false otherwise.
+ */
+static bool display(const Status & status, uint64_t now, FILE * stream)
+{
+    bool alive = (kill(status.pid, 0) == 0) || (errno != ESRCH);
+    const char * state = status.finished ? "DONE" : alive ? "RUN" : "DEAD";
+
+    uint64_t since = (status.started != 0) ? status.started : status.begun;
+    double elapsed = (now > since) ? seconds(now - since) : 0.0;
+
+    char remaining[32];
+    if (status.deadline == 0) {
+        snprintf(remaining, sizeof(remaining), "-");
+    } else if (status.deadline > now) {
+        snprintf(remaining, sizeof(remaining), "%.1f", seconds(status.deadline - now));
+    } else {
+        snprintf(remaining, sizeof(remaining), "0.0");
+    }
+
+    char progress[32];
+    snprintf(progress, sizeof(progress), "%u/%u", status.completed, status.total);
+
+    uint64_t user;
+    uint64_t system;
+    uint64_t resident;
+    const char * stale = "";
+    if ((!alive) || status.finished || (sample(status.pid, &user, &system, &resident) < 0)) {
+        user = status.user;
+        system = status.system;
+        resident = status.resident;
+        stale = "*";
+    }
+
+    char usage[3][32];
+    snprintf(usage[0], sizeof(usage[0]), "%.2f%s", user / 1000000.0, stale);
+    snprintf(usage[1], sizeof(usage[1]), "%.2f%s", system / 1000000.0, stale);
+    snprintf(usage[2], sizeof(usage[2]), "%llu%s", (unsigned long long)resident, stale);
+
+    fprintf(stream, "%-8d %-4s %-16.16s %11s %5u %5u %9.1f %9s %9s %9s %9s %s\n",
+        status.pid, state, status.program, progress, status.passed, status.failed,
+        elapsed, remaining, usage[0], usage[1], usage[2], status.test);
+
+    return alive;
+}
+
+/**
+ * Print the status of every page.
+ * @param stream points to an output stream to which the lines are printed.
+ * @param unlink if true removes the pages of writers that are no longer alive.
+ * @return the number of pages displayed, <0 for failure.
+ */
+static int sweep(FILE * stream, bool unlink)
+{
+    DIR * dir = opendir(SHM_DIR);
+    if (dir == 0) {
+        perror(SHM_DIR);
+        return -1;
+    }
+
+    int pages = 0;
+    uint64_t now = monotonic();
+
+    fprintf(stream, "%-8s %-4s %-16s %11s %5s %5s %9s %9s %9s %9s %9s %s\n",
+        "PID", "STAT", "PROGRAM", "DONE/TOTAL", "PASS", "FAIL",
+        "ELAPSED", "REMAIN", "USER", "SYS", "RSS(kB)", "TEST");
+
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != 0) {
+        if (strncmp(entry->d_name, STATUS_PREFIX, sizeof(STATUS_PREFIX) - 1) != 0) {
+            continue;
+        }
+        Status status;
+        if (statusread(entry->d_name, &status) < 0) {
+            continue;
+        }
+        ++pages;
+        if (display(status, now, stream)) {
+            // Do nothing.
+        } else if (!unlink) {
+            // Do nothing.
+        } else if (shm_unlink(entry->d_name) < 0) {
+            perror(entry->d_name);
+        } else {
+            // Do nothing.
+        }
+    }
+
+    closedir(dir);
+
+    return pages;
+}
+
+static void usage(const char * program, FILE * stream)
+{
+    fprintf(stream, "\n");
+    fprintf(stream, "usage: %s [ -i SECONDS ] [ -1 ] [ -u ] [ -? ]\n", program);
+    fprintf(stream, "       -i SECONDS    Refresh every SECONDS seconds (default 1)\n");
+    fprintf(stream, "       -1            Display once and exit\n");
+    fprintf(stream, "       -u            Unlink the pages of programs that died\n");
+    fprintf(stream, "       -?            Print menu\n");
+}
+
+int main(int argc, char ** argv)
+{
+    const char * program = strrchr(argv[0], '/');
+    program = (program == (char *)0) ? argv[0] : program + 1;
+
+    int opt;
+    bool once = false;
+    bool unlink = false;
+    unsigned long interval = 1;
+    while ((opt = getopt(argc, argv, "i:1u?")) >= 0) {
+
+        switch (opt) {
+
+        case 'i':
+            if (*number(optarg, &interval) != '\0') {
+                usage(program, stderr);
+                return 1;
+            }
+            break;
+
+        case '1':
+            once = true;
+            break;
+
+        case 'u':
+            unlink = true;
+            break;
+
+        case '?':
+            usage(program, stderr);
+            return 0;
+
+        default:
+            usage(program, stderr);
+            return 1;
+
+        }
+
+    }
+
+    bool terminal = isatty(STDOUT_FILENO);
+
+    while (true) {
+        if (terminal && (!once)) {
+            fputs("\033[H\033[J", stdout);
+        }
+        if (sweep(stdout, unlink) < 0) {
+            return 1;
+        }
+        fflush(stdout);
+        if (once) {
+            break;
+        }
+        sleep(interval);
+    }
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+/**
+ * @file
+ * Lariat Trace Converter
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ *
+ * usage: lariat-trace TRACEFILE > TRACE.json
+ */
+
+#include <cstdio>
+#include <cstring>
+#include "com/diag/lariat/trace.h"
+
+int main(int argc, char ** argv)
+{
+    const char * program = strrchr(argv[0], '/');
+    program = (program == (char *)0) ? argv[0] : program + 1;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s TRACEFILE\n", program);
+        return 1;
+    }
+
+    return (::com::diag::lariat::tracechrome(argv[1], stdout) < 0) ? 1 : 0;
+}
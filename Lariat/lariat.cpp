@@ -11,6 +11,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <stdint.h>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -23,6 +24,9 @@
 #endif
 #include "gtest/gtest.h"
 #include "com/diag/lariat/lariat.h"
+#include "com/diag/lariat/trace.h"
+#include "com/diag/lariat/metrics.h"
+#include "com/diag/lariat/status.h"
 
 using namespace std;
 
@@ -172,6 +176,158 @@ int timer(unsigned long seconds)
     return rc;
 }
 
+/**
+ * This listener records the phases of the unit test program into the timeline
+ * trace. Per-test fixture SetUp and TearDown fall inside the span of their
+ * test; fixtures that want finer detail can use LARIAT_TRACE_SCOPE.
+ */
+class Tracer : public ::testing::EmptyTestEventListener {
+
+public:
+
+    virtual void OnEnvironmentsSetUpStart(const ::testing::UnitTest & /* unit_test */) {
+        tracepoint('B', "SetUpEnvironments");
+    }
+
+    virtual void OnEnvironmentsSetUpEnd(const ::testing::UnitTest & /* unit_test */) {
+        tracepoint('E', "SetUpEnvironments");
+    }
+
+    virtual void OnTestCaseStart(const ::testing::TestCase & test_case) {
+        tracepoint('B', test_case.name());
+    }
+
+    virtual void OnTestStart(const ::testing::TestInfo & test_info) {
+        char name[TRACE_NAME];
+        tracepoint(TRACE_TEST_BEGIN, label(test_info, name, sizeof(name)));
+    }
+
+    virtual void OnTestEnd(const ::testing::TestInfo & test_info) {
+        char name[TRACE_NAME];
+        tracepoint(TRACE_TEST_END, label(test_info, name, sizeof(name)));
+    }
+
+    virtual void OnTestCaseEnd(const ::testing::TestCase & test_case) {
+        tracepoint('E', test_case.name());
+    }
+
+    virtual void OnEnvironmentsTearDownStart(const ::testing::UnitTest & /* unit_test */) {
+        tracepoint('B', "TearDownEnvironments");
+    }
+
+    virtual void OnEnvironmentsTearDownEnd(const ::testing::UnitTest & /* unit_test */) {
+        tracepoint('E', "TearDownEnvironments");
+    }
+
+private:
+
+    /**
+     * Names too long for a trace event keep as much of the front as fits
+     * followed by a hash of the whole name, so that tests that differ only
+     * past the cut (as parameterized tests often do) remain distinct.
+     */
+    static const char * label(const ::testing::TestInfo & test_info, char * buffer, size_t size) {
+        int length = snprintf(buffer, size, "%s.%s", test_info.test_case_name(), test_info.name());
+        if ((length >= 0) && ((size_t)length >= size)) {
+            static const size_t SUFFIX = sizeof("~01234567");
+            uint32_t hash = hashof(test_info.test_case_name(), 2166136261U);
+            hash = hashof(".", hash);
+            hash = hashof(test_info.name(), hash);
+            snprintf(buffer + size - SUFFIX, SUFFIX, "~%08x", hash);
+        }
+        return buffer;
+    }
+
+    /**
+     * Continue a 32-bit FNV-1a hash over a string.
+     */
+    static uint32_t hashof(const char * string, uint32_t hash) {
+        for (; *string != '\0'; ++string) {
+            hash = (hash ^ (unsigned char)*string) * 16777619U;
+        }
+        return hash;
+    }
+
+};
+
+/**
+ * This listener merges the metrics recorded by each test when the test ends
+ * and reports them both on standard output and as properties of the test.
+ */
+class Reporter : public ::testing::EmptyTestEventListener {
+
+public:
+
+    virtual void OnTestEnd(const ::testing::TestInfo & /* test_info */) {
+        unsigned int registered = metrics();
+        for (unsigned int ii = 0; ii < registered; ++ii) {
+            Summary summary;
+            if (metricsmerge(ii, &summary) <= 0) {
+                // Do nothing.
+            } else if (summary.counter) {
+                printf("[ COUNTER  ] %s=%llu\n", summary.name, (unsigned long long)summary.count);
+                property(summary.name, "", summary.count);
+            } else {
+                printf("[ METRIC   ] %s count=%llu p50=%llu p99=%llu p999=%llu max=%llu\n", summary.name, (unsigned long long)summary.count, (unsigned long long)summary.p50, (unsigned long long)summary.p99, (unsigned long long)summary.p999, (unsigned long long)summary.maximum);
+                property(summary.name, ".count", summary.count);
+                property(summary.name, ".p50", summary.p50);
+                property(summary.name, ".p99", summary.p99);
+                property(summary.name, ".p999", summary.p999);
+                property(summary.name, ".max", summary.maximum);
+            }
+        }
+        fflush(stdout);
+    }
+
+private:
+
+    static void property(const char * name, const char * suffix, uint64_t value) {
+        char key[256];
+        char text[sizeof("18446744073709551615")];
+        snprintf(key, sizeof(key), "metric.%s%s", name, suffix);
+        snprintf(text, sizeof(text), "%llu", (unsigned long long)value);
+        ::testing::Test::RecordProperty(key, text);
+    }
+
+};
+
+/**
+ * This listener keeps the live status page of the process up to date.
+ */
+class Monitor : public ::testing::EmptyTestEventListener {
+
+public:
+
+    explicit Monitor(const char * name)
+    : program(name)
+    {}
+
+    virtual void OnTestIterationStart(const ::testing::UnitTest & unit_test, int iteration) {
+        if (iteration == 0) {
+            statusopen(program, unit_test.test_to_run_count());
+        }
+    }
+
+    virtual void OnTestStart(const ::testing::TestInfo & test_info) {
+        char name[sizeof(Status().test)];
+        snprintf(name, sizeof(name), "%s.%s", test_info.test_case_name(), test_info.name());
+        statusstart(name);
+    }
+
+    virtual void OnTestEnd(const ::testing::TestInfo & test_info) {
+        statusend(test_info.result()->Passed());
+    }
+
+    virtual void OnTestProgramEnd(const ::testing::UnitTest & /* unit_test */) {
+        statusclose();
+    }
+
+private:
+
+    const char * program;
+
+};
+
 /**
  * Print a usage menu.
  * @param program points to the program name.
@@ -180,7 +336,7 @@ int timer(unsigned long seconds)
 static void usage(const char * program, FILE * stream)
 {
     fprintf(stream, "\n");
-    fprintf(stream, "usage: %s [ -c SECONDS | -C ] [ -d BYTES | -D ] [ -e BYTES | -E ] [ -f BYTES | -F ] [ -m BYTES | -M ] [ -o OPENED | -O ] [ -r SECONDS | -R ] [ -s BYTES | -S ] [ -t THREADS | -T ] [ -0 ] [ -! ] [ -? ]\n", program);
+    fprintf(stream, "usage: %s [ -c SECONDS | -C ] [ -d BYTES | -D ] [ -e BYTES | -E ] [ -f BYTES | -F ] [ -m BYTES | -M ] [ -o OPENED | -O ] [ -r SECONDS | -R ] [ -s BYTES | -S ] [ -t THREADS | -T ] [ -p ] [ -x TRACEFILE ] [ -0 ] [ -! ] [ -? ]\n", program);
     fprintf(stream, "       -c SECONDS    Set the process CPU time limit to SECONDS\n");
     fprintf(stream, "       -C            Set the process CPU time limit to unlimited\n");
     fprintf(stream, "       -d BYTES      Set the process data segment size limit to BYTES\n");
@@ -199,6 +355,8 @@ static void usage(const char * program, FILE * stream)
     fprintf(stream, "       -S            Set the process stack size limit to unlimited\n");
     fprintf(stream, "       -t THREADS    Set the user process and thread limit to THREADS\n");
     fprintf(stream, "       -T            Set the user process and thread limit to unlimited\n");
+    fprintf(stream, "       -p            Publish a live status page for lariat-top\n");
+    fprintf(stream, "       -x TRACEFILE  Record a timeline trace in TRACEFILE\n");
     fprintf(stream, "       -0            Do not actually run any tests\n");
     fprintf(stream, "       -!            Enable debug output\n");
     fprintf(stream, "       -?            Print menu\n");
@@ -213,6 +371,16 @@ int main(int argc, char ** argv, char ** envp)
     	perror("setpgid");
     }
 
+    // Death test children that Google Test re-executes must not publish a
+    // status page that would outlive them.
+    bool child = false;
+    for (int ii = 1; ii < argc; ++ii) {
+        if (strncmp(argv[ii], "--gtest_internal_run_death_test", sizeof("--gtest_internal_run_death_test") - 1) == 0) {
+            child = true;
+            break;
+        }
+    }
+
 #if defined(COM_DIAG_LARIAT_GMOCK)
     ::testing::InitGoogleMock(&argc, argv);
 #else
@@ -223,8 +391,10 @@ int main(int argc, char ** argv, char ** envp)
     bool debug = false;
     bool done = false;
     bool error = false;
+    bool tracing = false;
+    bool publishing = false;
     unsigned long value;
-    while ((opt = getopt(argc, argv, "c:Cd:De:Ef:Fm:Mo:Os:Rr:St:T0!?")) >= 0) {
+    while ((opt = getopt(argc, argv, "c:Cd:De:Ef:Fm:Mo:Ops:Rr:St:Tx:0!?")) >= 0) {
 
         switch (opt) {
 
@@ -336,6 +506,28 @@ int main(int argc, char ** argv, char ** envp)
             }
             break;
 
+        case 'p':
+            publishing = !child;
+            if (debug) {
+            	fprintf(stderr, "%s: -%c\n", program, opt);
+            }
+            break;
+
+        case 'x':
+            {
+                // Leave room in the main thread's ring for a begin and an end
+                // event for every test and test case, on top of the default
+                // for whatever the tests record themselves, so that the spans
+                // of the first tests are not overwritten by those of the last.
+                const ::testing::UnitTest * unit = ::testing::UnitTest::GetInstance();
+                unsigned int events = TRACE_EVENTS + (2 * (unit->total_test_count() + unit->total_test_case_count()));
+                if ((!(error = (traceopen(optarg, TRACE_THREADS, events) < 0))) && debug) {
+                	fprintf(stderr, "%s: -%c %s %u\n", program, opt, optarg, events);
+                }
+            }
+            tracing = !error;
+            break;
+
         case '0':
         	done = true;
         	if (debug) {
@@ -393,7 +585,26 @@ int main(int argc, char ** argv, char ** envp)
     	exit(0);
     }
 
-    return RUN_ALL_TESTS();
+    if (tracing) {
+        ::testing::UnitTest::GetInstance()->listeners().Append(new Tracer);
+    }
+
+    if (publishing) {
+        ::testing::UnitTest::GetInstance()->listeners().Append(new Monitor(program));
+    }
+
+    ::testing::UnitTest::GetInstance()->listeners().Append(new Reporter);
+    metricsopen();
+
+    int rc = RUN_ALL_TESTS();
+
+    metricsclose();
+
+    if (tracing) {
+        traceclose();
+    }
+
+    return rc;
 }
 
 
@@ -0,0 +1,370 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+/**
+ * @file
+ * Lariat Test Metrics Implementation
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ */
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <pthread.h>
+#include "com/diag/lariat/metrics.h"
+
+using namespace std;
+
+namespace com {
+namespace diag {
+namespace lariat {
+
+/**
+ * Each power of two above the exact range is divided into this many buckets.
+ */
+static const unsigned int SUBBITS = 5;
+
+static const unsigned int SUBBUCKETS = 1 << SUBBITS;
+
+/**
+ * Values below this are counted exactly, one per bucket.
+ */
+static const uint64_t EXACT = SUBBUCKETS * 2;
+
+static const unsigned int BUCKETS = ((64 - SUBBITS + 1) * SUBBUCKETS);
+
+struct Histogram {
+    volatile uint64_t count;
+    volatile uint64_t maximum;
+    volatile uint64_t bucket[BUCKETS];
+};
+
+struct Shard {
+    Shard * next;
+    volatile int owned;
+    volatile uint64_t counter[METRICS];
+    Histogram * volatile histogram[METRICS];
+};
+
+static const char * name[METRICS];
+
+static bool counter[METRICS];
+
+static volatile unsigned int registered = 0;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile bool enabled = false;
+
+static Shard * volatile shards = 0;
+
+static pthread_key_t key;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static __thread Shard * mine = 0;
+
+static unsigned int bucketof(uint64_t value)
+{
+    if (value < EXACT) {
+        return value;
+    }
+
+    unsigned int shift = (63 - __builtin_clzll(value)) - SUBBITS;
+
+    return (shift * SUBBUCKETS) + (value >> shift);
+}
+
+static uint64_t highest(unsigned int bucket)
+{
+    if (bucket < EXACT) {
+        return bucket;
+    }
+
+    unsigned int shift = (bucket / SUBBUCKETS) - 1;
+    uint64_t mantissa = bucket - (shift * SUBBUCKETS);
+
+    return (((mantissa + 1) << shift) - 1);
+}
+
+/**
+ * Release the shard of an exiting thread so that a later thread can reuse it.
+ * @param arg points to the shard.
+ */
+static void release(void * arg)
+{
+    static_cast<Shard *>(arg)->owned = 0;
+}
+
+static void initialize()
+{
+    if ((errno = pthread_key_create(&key, release)) != 0) {
+        perror("pthread_key_create");
+    }
+}
+
+/**
+ * Allocate the histogram of a metric in a shard if it needs one and does not
+ * have one yet. This keeps allocation off the recording path. The caller
+ * must hold the mutex.
+ * @param shard points to the shard.
+ * @param index is the index of the metric.
+ */
+static void provision(Shard * shard, unsigned int index)
+{
+    if (counter[index]) {
+        // Do nothing.
+    } else if (shard->histogram[index] != 0) {
+        // Do nothing.
+    } else if ((shard->histogram[index] = static_cast<Histogram *>(calloc(1, sizeof(Histogram)))) == 0) {
+        perror("calloc");
+    } else {
+        // Do nothing.
+    }
+}
+
+/**
+ * Claim an idle shard, or allocate and push a new one, for the calling thread,
+ * and provision it with a histogram for every metric registered so far.
+ * @return a pointer to the shard or null if none could be allocated.
+ */
+static Shard * claim()
+{
+    Shard * shard;
+
+    pthread_once(&once, initialize);
+
+    for (shard = shards; shard != 0; shard = shard->next) {
+        if (__sync_bool_compare_and_swap(&(shard->owned), 0, 1)) {
+            break;
+        }
+    }
+
+    if (shard != 0) {
+        // Do nothing.
+    } else if ((shard = static_cast<Shard *>(calloc(1, sizeof(Shard)))) == 0) {
+        perror("calloc");
+        return 0;
+    } else {
+        shard->owned = 1;
+        do {
+            shard->next = shards;
+        } while (!__sync_bool_compare_and_swap(&shards, shard->next, shard));
+    }
+
+    pthread_mutex_lock(&mutex);
+    for (unsigned int ii = 0; ii < registered; ++ii) {
+        provision(shard, ii);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if ((errno = pthread_setspecific(key, shard)) != 0) {
+        perror("pthread_setspecific");
+    }
+
+    mine = shard;
+
+    return shard;
+}
+
+int metricsopen()
+{
+    enabled = true;
+    return 0;
+}
+
+int metricsclose()
+{
+    enabled = false;
+    return 0;
+}
+
+int metric(const char * label, bool kind)
+{
+    int index = -1;
+    unsigned int ii;
+
+    // The first lookup by a thread claims its shard so that recording, which
+    // usually follows, does not have to.
+    if (mine == 0) {
+        claim();
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    for (ii = 0; ii < registered; ++ii) {
+        if (strcmp(name[ii], label) == 0) {
+            break;
+        }
+    }
+
+    if (ii < registered) {
+        if (counter[ii] == kind) {
+            index = ii;
+        } else {
+            errno = EINVAL;
+            perror(label);
+        }
+    } else if (registered >= METRICS) {
+        errno = ENOSPC;
+        perror(label);
+    } else if ((name[ii] = strdup(label)) == 0) {
+        perror("strdup");
+    } else {
+        counter[ii] = kind;
+        for (Shard * shard = shards; shard != 0; shard = shard->next) {
+            provision(shard, ii);
+        }
+        registered = ii + 1;
+        index = ii;
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    return index;
+}
+
+unsigned int metrics()
+{
+    return registered;
+}
+
+void record(int index, uint64_t value)
+{
+    if (!enabled) {
+        return;
+    }
+
+    if (index < 0) {
+        return;
+    }
+
+    Shard * shard = mine;
+    if ((shard == 0) && ((shard = claim()) == 0)) {
+        return;
+    }
+
+    Histogram * histogram = shard->histogram[index];
+    if (histogram == 0) {
+        return;
+    }
+
+    __sync_fetch_and_add(&(histogram->bucket[bucketof(value)]), 1);
+    __sync_fetch_and_add(&(histogram->count), 1);
+
+    uint64_t maximum = histogram->maximum;
+    while ((value > maximum) && (!__sync_bool_compare_and_swap(&(histogram->maximum), maximum, value))) {
+        maximum = histogram->maximum;
+    }
+}
+
+void count(int index)
+{
+    if (!enabled) {
+        return;
+    }
+
+    if (index < 0) {
+        return;
+    }
+
+    Shard * shard = mine;
+    if ((shard == 0) && ((shard = claim()) == 0)) {
+        return;
+    }
+
+    __sync_fetch_and_add(&(shard->counter[index]), 1);
+}
+
+/**
+ * Return the value at or below which the specified fraction of a histogram
+ * falls.
+ * @param bucket is the merged bucket array.
+ * @param total is the number of values in the histogram.
+ * @param maximum is the largest value in the histogram.
+ * @param fraction is the percentile divided by one hundred.
+ * @return the largest value of the bucket containing the percentile.
+ */
+static uint64_t percentile(const uint64_t * bucket, uint64_t total, uint64_t maximum, double fraction)
+{
+    uint64_t rank = (uint64_t)((fraction * total) + 0.5);
+    uint64_t cumulative = 0;
+
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    for (unsigned int ii = 0; ii < BUCKETS; ++ii) {
+        cumulative += bucket[ii];
+        if (cumulative >= rank) {
+            uint64_t value = highest(ii);
+            return (value < maximum) ? value : maximum;
+        }
+    }
+
+    return maximum;
+}
+
+int metricsmerge(int index, Summary * summaryp)
+{
+    if ((index < 0) || (index >= (int)registered)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t bucket[BUCKETS];
+    uint64_t total = 0;
+    uint64_t maximum = 0;
+
+    memset(bucket, 0, sizeof(bucket));
+
+    for (Shard * shard = shards; shard != 0; shard = shard->next) {
+        if (counter[index]) {
+            total += __sync_fetch_and_and(&(shard->counter[index]), 0);
+            continue;
+        }
+        Histogram * histogram = shard->histogram[index];
+        if (histogram == 0) {
+            continue;
+        }
+        if (histogram->count == 0) {
+            continue;
+        }
+        total += __sync_fetch_and_and(&(histogram->count), 0);
+        uint64_t peak = __sync_fetch_and_and(&(histogram->maximum), 0);
+        if (peak > maximum) {
+            maximum = peak;
+        }
+        for (unsigned int ii = 0; ii < BUCKETS; ++ii) {
+            if (histogram->bucket[ii] != 0) {
+                bucket[ii] += __sync_fetch_and_and(&(histogram->bucket[ii]), 0);
+            }
+        }
+    }
+
+    Summary summary;
+    memset(&summary, 0, sizeof(summary));
+    summary.name = name[index];
+    summary.counter = counter[index];
+    summary.count = total;
+
+    if ((!summary.counter) && (total > 0)) {
+        summary.p50 = percentile(bucket, total, maximum, 0.50);
+        summary.p99 = percentile(bucket, total, maximum, 0.99);
+        summary.p999 = percentile(bucket, total, maximum, 0.999);
+        summary.maximum = maximum;
+    }
+
+    if (summaryp != 0) {
+        *summaryp = summary;
+    }
+
+    return (total > 0) ? 1 : 0;
+}
+
+}
+}
+}
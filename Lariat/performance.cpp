@@ -0,0 +1,272 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+/**
+ * @file
+ * Lariat Performance Assertions Implementation
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ */
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <algorithm>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include "com/diag/lariat/performance.h"
+
+using namespace std;
+
+namespace com {
+namespace diag {
+namespace lariat {
+
+/**
+ * These are defined in allocs.o, which the unit test program links only if it
+ * wants allocations counted.
+ */
+extern void allocsstart() __attribute__((weak));
+extern uint64_t allocsstop() __attribute__((weak));
+
+static const char * NAME[] = {
+    "walltime",
+    "cputime",
+    "allocs",
+    "syscalls",
+    "instructions",
+};
+
+static const char * UNIT[] = {
+    "ns",
+    "ns",
+    "",
+    "",
+    "",
+};
+
+/**
+ * Open a perf event counter for the calling thread, initially disabled.
+ * @param type is the perf event type.
+ * @param config is the perf event configuration.
+ * @return a file descriptor, <0 if the kernel does not permit it.
+ */
+static int perf(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_hv = 1;
+    if (type == PERF_TYPE_HARDWARE) {
+        attr.exclude_kernel = 1;
+    }
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Return the tracepoint identifier of system call entry.
+ * @return the identifier, or ~0 if tracefs is not available.
+ */
+static uint64_t sysenter()
+{
+    static const char * PATH[] = {
+        "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+        "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+    };
+    uint64_t id = ~(uint64_t)0;
+
+    for (unsigned int ii = 0; ii < sizeof(PATH) / sizeof(PATH[0]); ++ii) {
+        FILE * fp = fopen(PATH[ii], "r");
+        if (fp == 0) {
+            continue;
+        }
+        unsigned long long value;
+        if (fscanf(fp, "%llu", &value) == 1) {
+            id = value;
+        }
+        fclose(fp);
+        break;
+    }
+
+    return id;
+}
+
+static uint64_t nanoseconds(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+Probe::Probe(Meter meter)
+: kind(meter)
+, fd(-1)
+, usable(true)
+, baseline(0)
+, before(0)
+{
+    if (kind == SYSCALLS) {
+        uint64_t id = sysenter();
+        usable = (id != ~(uint64_t)0) && ((fd = perf(PERF_TYPE_TRACEPOINT, id)) >= 0);
+    } else if (kind == INSTRUCTIONS) {
+        usable = ((fd = perf(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS)) >= 0);
+    } else if (kind == ALLOCS) {
+        usable = (allocsstart != 0) && (allocsstop != 0);
+    } else {
+        // Do nothing.
+    }
+
+    if (usable) {
+        static const int CALIBRATIONS = 7;
+        uint64_t least = ~(uint64_t)0;
+        for (int ii = 0; ii < CALIBRATIONS; ++ii) {
+            start();
+            uint64_t sample = stop();
+            if (sample < least) {
+                least = sample;
+            }
+        }
+        baseline = least;
+    }
+}
+
+Probe::~Probe()
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void Probe::start()
+{
+    switch (kind) {
+    case WALLTIME:
+        before = nanoseconds(CLOCK_MONOTONIC);
+        break;
+    case CPUTIME:
+        before = nanoseconds(CLOCK_THREAD_CPUTIME_ID);
+        break;
+    case ALLOCS:
+        allocsstart();
+        break;
+    case SYSCALLS:
+    case INSTRUCTIONS:
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        break;
+    }
+}
+
+uint64_t Probe::stop()
+{
+    uint64_t after = 0;
+    uint64_t cost = 0;
+
+    switch (kind) {
+    case WALLTIME:
+        after = nanoseconds(CLOCK_MONOTONIC);
+        cost = after - before;
+        break;
+    case CPUTIME:
+        after = nanoseconds(CLOCK_THREAD_CPUTIME_ID);
+        cost = after - before;
+        break;
+    case ALLOCS:
+        cost = allocsstop();
+        break;
+    case SYSCALLS:
+    case INSTRUCTIONS:
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &after, sizeof(after)) == sizeof(after)) {
+            cost = after;
+        }
+        break;
+    }
+
+    return (cost > baseline) ? (cost - baseline) : 0;
+}
+
+/**
+ * Return the value below which the specified fraction of sorted samples fall.
+ * @param samples points to the sorted samples.
+ * @param count is the number of samples.
+ * @param fraction is the percentile divided by one hundred.
+ * @return the sample at that rank.
+ */
+static uint64_t quantile(const uint64_t * samples, unsigned int count, double fraction)
+{
+    unsigned int rank = (unsigned int)((fraction * (count - 1)) + 0.5);
+    return samples[rank];
+}
+
+::testing::AssertionResult assess(const Probe & probe, uint64_t * samples, unsigned int count, const char * statement, uint64_t bound, const char * text, const char * file, int line)
+{
+    Meter meter = probe.meter();
+
+    if (!probe.available()) {
+        // An assertion that cannot be checked must not look like one that
+        // passed: record which, and where Google Test can, mark the test as
+        // skipped (any failure of the test still takes precedence).
+        char key[64];
+        snprintf(key, sizeof(key), "lariat.unavailable.%s", NAME[meter]);
+        ::testing::Test::RecordProperty(key, statement);
+#if defined(GTEST_SKIP)
+        GTEST_MESSAGE_AT_(file, line, "", ::testing::TestPartResult::kSkip)
+            << "Cannot measure " << NAME[meter] << " of " << statement << " on this host";
+#else
+        fprintf(stderr, "%s:%d: lariat: cannot measure %s of %s on this host\n", file, line, NAME[meter], statement);
+#endif
+        return ::testing::AssertionSuccess();
+    }
+
+    sort(samples, samples + count);
+
+    uint64_t median = quantile(samples, count, 0.50);
+
+    // Allocations and system calls are counts, not times: a repetition that
+    // does more of them than the bound allows is a real cost, not noise, so
+    // it is the most of any repetition that is compared against the bound.
+    bool exact = (meter == ALLOCS) || (meter == SYSCALLS);
+    uint64_t statistic = exact ? samples[count - 1] : median;
+
+    if (statistic <= bound) {
+        return ::testing::AssertionSuccess();
+    }
+
+    vector<uint64_t> deviation(count);
+    for (unsigned int ii = 0; ii < count; ++ii) {
+        deviation[ii] = (samples[ii] > median) ? (samples[ii] - median) : (median - samples[ii]);
+    }
+    sort(deviation.begin(), deviation.end());
+
+    const char * unit = UNIT[meter];
+
+    return ::testing::AssertionFailure()
+        << "Expected " << NAME[meter] << " of " << statement << " <= " << text << " (" << bound << unit << ")\n"
+        << "  Actual: " << (exact ? "max=" : "median=") << statistic << unit
+        << (exact ? " median=" : " max=") << (exact ? median : samples[count - 1]) << unit
+        << " min=" << samples[0] << unit
+        << " q1=" << quantile(samples, count, 0.25) << unit
+        << " q3=" << quantile(samples, count, 0.75) << unit
+        << " p90=" << quantile(samples, count, 0.90) << unit
+        << " mad=" << quantile(&(deviation[0]), count, 0.50) << unit
+        << " n=" << count
+        << " overhead=" << probe.overhead() << unit;
+}
+
+}
+}
+}
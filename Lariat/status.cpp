@@ -0,0 +1,299 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+/**
+ * @file
+ * Lariat Live Status Page Implementation
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include "com/diag/lariat/status.h"
+
+using namespace std;
+
+namespace com {
+namespace diag {
+namespace lariat {
+
+static const char MAGIC[8] = { 'L', 'A', 'R', 'I', 'A', 'T', 'S', 'P' };
+
+static const uint32_t VERSION = 1;
+
+static Status * page = 0;
+
+static char named[sizeof(STATUS_PREFIX) + sizeof("/4294967295")];
+
+uint64_t monotonic()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+/**
+ * Forked children, death tests among them, stop using the page of their parent.
+ */
+static void child()
+{
+    if (page != 0) {
+        munmap(page, sizeof(*page));
+        page = 0;
+    }
+}
+
+/**
+ * Begin an update by making the sequence number odd.
+ */
+static void acquire()
+{
+    page->sequence = page->sequence + 1;
+    __sync_synchronize();
+}
+
+/**
+ * End an update by making the sequence number even.
+ */
+static void release()
+{
+    page->updated = monotonic();
+    __sync_synchronize();
+    page->sequence = page->sequence + 1;
+}
+
+/**
+ * Refresh the resource usage and the real time timer deadline.
+ * @param now is the current time.
+ */
+static void refresh(uint64_t now)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        page->user = (usage.ru_utime.tv_sec * 1000000ULL) + usage.ru_utime.tv_usec;
+        page->system = (usage.ru_stime.tv_sec * 1000000ULL) + usage.ru_stime.tv_usec;
+        page->resident = usage.ru_maxrss;
+        page->minor = usage.ru_minflt;
+        page->major = usage.ru_majflt;
+        page->voluntary = usage.ru_nvcsw;
+        page->involuntary = usage.ru_nivcsw;
+    }
+
+    struct itimerval timer;
+    if (getitimer(ITIMER_REAL, &timer) < 0) {
+        // Do nothing.
+    } else if ((timer.it_value.tv_sec == 0) && (timer.it_value.tv_usec == 0)) {
+        page->deadline = 0;
+    } else {
+        page->deadline = now + (timer.it_value.tv_sec * 1000000000ULL) + (timer.it_value.tv_usec * 1000ULL);
+    }
+}
+
+int statusopen(const char * program, unsigned int total)
+{
+    static bool registered = false;
+    int rc = -1;
+    int fd = -1;
+
+    do {
+
+        if (page != 0) {
+            errno = EBUSY;
+            perror(named);
+            break;
+        }
+
+        snprintf(named, sizeof(named), "/%s%d", STATUS_PREFIX, getpid());
+
+        if ((fd = shm_open(named, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+            perror(named);
+            break;
+        }
+
+        if (ftruncate(fd, sizeof(Status)) < 0) {
+            perror("ftruncate");
+            shm_unlink(named);
+            break;
+        }
+
+        void * map = mmap(0, sizeof(Status), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            shm_unlink(named);
+            break;
+        }
+
+        if (!registered) {
+            if ((errno = pthread_atfork(0, 0, child)) != 0) {
+                perror("pthread_atfork");
+            } else {
+                registered = true;
+            }
+        }
+
+        page = static_cast<Status *>(map);
+        memcpy(page->magic, MAGIC, sizeof(MAGIC));
+        page->version = VERSION;
+        page->pid = getpid();
+
+        acquire();
+        page->total = total;
+        page->begun = monotonic();
+        strncpy(page->program, program, sizeof(page->program) - 1);
+        refresh(page->begun);
+        release();
+
+        rc = 0;
+
+    } while (0);
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return rc;
+}
+
+void statusstart(const char * test)
+{
+    if (page == 0) {
+        return;
+    }
+
+    uint64_t now = monotonic();
+
+    acquire();
+    page->started = now;
+    strncpy(page->test, test, sizeof(page->test) - 1);
+    refresh(now);
+    release();
+}
+
+void statusend(bool passed)
+{
+    if (page == 0) {
+        return;
+    }
+
+    acquire();
+    page->completed = page->completed + 1;
+    if (passed) {
+        page->passed = page->passed + 1;
+    } else {
+        page->failed = page->failed + 1;
+    }
+    page->started = 0;
+    page->test[0] = '\0';
+    refresh(monotonic());
+    release();
+}
+
+int statusclose()
+{
+    int rc = 0;
+
+    if (page != 0) {
+        acquire();
+        page->finished = !0;
+        release();
+        if ((rc = munmap(page, sizeof(*page))) < 0) {
+            perror("munmap");
+        }
+        page = 0;
+        if ((rc = shm_unlink(named)) < 0) {
+            perror(named);
+        }
+    }
+
+    return rc;
+}
+
+int statusread(const char * name, Status * statusp)
+{
+    int rc = -1;
+    int fd = -1;
+    void * map = MAP_FAILED;
+    char path[256];
+
+    do {
+
+        snprintf(path, sizeof(path), "%s%s", (name[0] == '/') ? "" : "/", name);
+
+        if ((fd = shm_open(path, O_RDONLY, 0)) < 0) {
+            if (errno != ENOENT) {
+                perror(path);
+            }
+            break;
+        }
+
+        struct stat state;
+        if (fstat(fd, &state) < 0) {
+            perror("fstat");
+            break;
+        }
+
+        if (state.st_size < (off_t)sizeof(Status)) {
+            errno = EINVAL;
+            break;
+        }
+
+        if ((map = mmap(0, sizeof(Status), PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+            perror("mmap");
+            break;
+        }
+
+        const Status * shared = static_cast<const Status *>(map);
+
+        if ((memcmp(shared->magic, MAGIC, sizeof(MAGIC)) != 0) || (shared->version != VERSION)) {
+            errno = EINVAL;
+            break;
+        }
+
+        for (int tries = 0; tries < 1000; ++tries) {
+            uint32_t before = shared->sequence;
+            __sync_synchronize();
+            memcpy(statusp, (const void *)shared, sizeof(*statusp));
+            __sync_synchronize();
+            if (((before & 1) == 0) && (shared->sequence == before)) {
+                rc = 0;
+                break;
+            }
+            sched_yield();
+        }
+
+        if (rc < 0) {
+            errno = EAGAIN;
+        }
+
+        statusp->program[sizeof(statusp->program) - 1] = '\0';
+        statusp->test[sizeof(statusp->test) - 1] = '\0';
+
+    } while (0);
+
+    if (map != MAP_FAILED) {
+        munmap(map, sizeof(Status));
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return rc;
+}
+
+}
+}
+}
@@ -0,0 +1,446 @@
+/* vi: set ts=4 expandtab shiftwidth=4: */
+/**
+ * @file
+ * Lariat Timeline Trace Implementation
+ * Copyright 2011 Digital Aggregates Corporation, Colorado, USA
+ * Licensed under the terms in README.h
+ * Chip Overclock (coverclock@diag.com)
+ * http://www.diag.com/navigation/downloads/Lariat.html
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "com/diag/lariat/trace.h"
+
+using namespace std;
+
+namespace com {
+namespace diag {
+namespace lariat {
+
+/**
+ * This environmental variable names the trace file of the parent process so
+ * that an exec'ed death test child reattaches to it instead of truncating it.
+ */
+static const char ENVIRONMENT[] = "COM_DIAG_LARIAT_TRACE";
+
+static const char MAGIC[8] = { 'L', 'A', 'R', 'I', 'A', 'T', 'T', 'R' };
+
+static const uint32_t VERSION = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t threads;
+    uint32_t events;
+    uint32_t claimed;
+    char reserved[40];
+};
+
+struct Event {
+    uint64_t nanoseconds;
+    char phase;
+    char reserved[7];
+    char name[TRACE_NAME];
+};
+
+struct Ring {
+    int32_t pid;
+    int32_t tid;
+    volatile uint64_t count;
+    char reserved[48];
+    Event event[1];
+};
+
+static size_t stride(uint32_t events)
+{
+    return sizeof(Ring) + ((events - 1) * sizeof(Event));
+}
+
+static size_t extent(uint32_t threads, uint32_t events)
+{
+    return sizeof(Header) + (threads * stride(events));
+}
+
+static Ring * ringof(Header * header, uint32_t index)
+{
+    return reinterpret_cast<Ring *>(reinterpret_cast<char *>(header) + sizeof(Header) + (index * stride(header->events)));
+}
+
+static Header * base = 0;
+
+static size_t length = 0;
+
+static char pathname[PATH_MAX];
+
+static __thread Ring * mine = 0;
+
+static __thread bool starved = false;
+
+static Ring * claim()
+{
+    Ring * ring = 0;
+
+    uint32_t index = __sync_fetch_and_add(&(base->claimed), 1);
+    if (index < base->threads) {
+        ring = ringof(base, index);
+        ring->pid = getpid();
+        ring->tid = syscall(SYS_gettid);
+        // Fault in the ring now so that recording events later doesn't.
+        memset(ring->event, 0, base->events * sizeof(Event));
+        mine = ring;
+    } else {
+        starved = true;
+    }
+
+    return ring;
+}
+
+void tracepoint(char phase, const char * name)
+{
+    if (base == 0) {
+        return;
+    }
+
+    Ring * ring = mine;
+    if (ring != 0) {
+        // Do nothing.
+    } else if (starved) {
+        return;
+    } else if ((ring = claim()) == 0) {
+        return;
+    } else {
+        // Do nothing.
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint64_t count = ring->count;
+    Event * event = &(ring->event[count % base->events]);
+    event->nanoseconds = (now.tv_sec * 1000000000ULL) + now.tv_nsec;
+    event->phase = phase;
+    size_t size = strnlen(name, sizeof(event->name) - 1);
+    memcpy(event->name, name, size);
+    event->name[size] = '\0';
+    ring->count = count + 1;
+}
+
+static void prepare()
+{
+    tracepoint('i', "fork");
+}
+
+static void child()
+{
+    mine = 0;
+    starved = false;
+}
+
+int traceopen(const char * path, unsigned int threads, unsigned int events)
+{
+    static bool registered = false;
+    int rc = -1;
+    int fd = -1;
+
+    do {
+
+        if (base != 0) {
+            errno = EBUSY;
+            perror(path);
+            break;
+        }
+
+        const char * inherited = getenv(ENVIRONMENT);
+        bool attach = ((inherited != 0) && (strcmp(inherited, path) == 0));
+
+        if (attach) {
+
+            if ((fd = open(path, O_RDWR)) < 0) {
+                perror(path);
+                break;
+            }
+
+            Header header;
+            if (read(fd, &header, sizeof(header)) != sizeof(header)) {
+                errno = EINVAL;
+                perror(path);
+                break;
+            }
+
+            if ((memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) || (header.version != VERSION)) {
+                errno = EINVAL;
+                perror(path);
+                break;
+            }
+
+            threads = header.threads;
+            events = header.events;
+
+            struct stat state;
+            if (fstat(fd, &state) < 0) {
+                perror("fstat");
+                break;
+            }
+
+            if ((events == 0) || (state.st_size < (off_t)extent(threads, events))) {
+                errno = EINVAL;
+                perror(path);
+                break;
+            }
+
+        } else {
+
+            if ((threads == 0) || (events == 0)) {
+                errno = EINVAL;
+                perror(path);
+                break;
+            }
+
+            if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+                perror(path);
+                break;
+            }
+
+            if (ftruncate(fd, extent(threads, events)) < 0) {
+                perror("ftruncate");
+                break;
+            }
+
+        }
+
+        size_t size = extent(threads, events);
+        void * map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            break;
+        }
+
+        if (!attach) {
+            Header * header = static_cast<Header *>(map);
+            memcpy(header->magic, MAGIC, sizeof(MAGIC));
+            header->version = VERSION;
+            header->threads = threads;
+            header->events = events;
+            header->claimed = 0;
+            if (setenv(ENVIRONMENT, path, !0) < 0) {
+                perror("setenv");
+            }
+        }
+
+        if (!registered) {
+            if ((errno = pthread_atfork(prepare, 0, child)) != 0) {
+                perror("pthread_atfork");
+            } else {
+                registered = true;
+            }
+        }
+
+        mine = 0;
+        starved = false;
+        length = size;
+        strncpy(pathname, path, sizeof(pathname) - 1);
+        base = static_cast<Header *>(map);
+
+        if (attach) {
+            tracepoint('i', "exec");
+        }
+
+        rc = 0;
+
+    } while (0);
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return rc;
+}
+
+const char * tracepath()
+{
+    return (base != 0) ? pathname : 0;
+}
+
+int traceclose()
+{
+    int rc = 0;
+
+    if (base != 0) {
+        void * map = base;
+        base = 0;
+        if ((rc = munmap(map, length)) < 0) {
+            perror("munmap");
+        }
+        length = 0;
+        pathname[0] = '\0';
+    }
+
+    return rc;
+}
+
+/**
+ * Print a string as a JSON string literal.
+ * @param string points to the string.
+ * @param stream points to an output stream to which the literal is printed.
+ */
+static void quote(const char * string, FILE * stream)
+{
+    fputc('"', stream);
+    for (; *string != '\0'; ++string) {
+        unsigned char ch = *string;
+        if ((ch == '"') || (ch == '\\')) {
+            fprintf(stream, "\\%c", ch);
+        } else if (ch < ' ') {
+            fprintf(stream, "\\u%04x", ch);
+        } else {
+            fputc(ch, stream);
+        }
+    }
+    fputc('"', stream);
+}
+
+int tracevisit(const char * path, TraceVisitor visitor, void * context)
+{
+    int rc = -1;
+    int fd = -1;
+    void * map = MAP_FAILED;
+    size_t size = 0;
+
+    do {
+
+        if ((fd = open(path, O_RDONLY)) < 0) {
+            perror(path);
+            break;
+        }
+
+        Header header;
+        if (read(fd, &header, sizeof(header)) != sizeof(header)) {
+            errno = EINVAL;
+            perror(path);
+            break;
+        }
+
+        if ((memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) || (header.version != VERSION) || (header.events == 0)) {
+            errno = EINVAL;
+            perror(path);
+            break;
+        }
+
+        size = extent(header.threads, header.events);
+
+        struct stat state;
+        if (fstat(fd, &state) < 0) {
+            perror("fstat");
+            break;
+        }
+
+        if (state.st_size < (off_t)size) {
+            errno = EINVAL;
+            perror(path);
+            break;
+        }
+
+        if ((map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+            perror("mmap");
+            break;
+        }
+
+        Header * mapped = static_cast<Header *>(map);
+        uint32_t claimed = (header.claimed < header.threads) ? header.claimed : header.threads;
+        int visited = 0;
+
+        if (header.claimed > header.threads) {
+            fprintf(stderr, "%s: no free ring for %u more threads or processes, whose events were dropped\n", path, header.claimed - header.threads);
+        }
+
+        for (uint32_t index = 0; index < claimed; ++index) {
+            Ring * ring = ringof(mapped, index);
+            uint64_t count = ring->count;
+            uint64_t first = (count > header.events) ? (count - header.events) : 0;
+            if (first > 0) {
+                fprintf(stderr, "%s: process %d thread %d lost its first %llu events\n", path, ring->pid, ring->tid, (unsigned long long)first);
+            }
+            for (uint64_t ii = first; ii < count; ++ii) {
+                const Event * event = &(ring->event[ii % header.events]);
+                char name[TRACE_NAME];
+                strncpy(name, event->name, sizeof(name) - 1);
+                name[sizeof(name) - 1] = '\0';
+                (*visitor)(context, ring->pid, ring->tid, event->phase, event->nanoseconds, name);
+                ++visited;
+            }
+        }
+
+        rc = visited;
+
+    } while (0);
+
+    if (map != MAP_FAILED) {
+        munmap(map, size);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return rc;
+}
+
+struct Chrome {
+    FILE * stream;
+    const char * separator;
+};
+
+static void chrome(void * context, int pid, int tid, char phase, uint64_t nanoseconds, const char * name)
+{
+    Chrome * state = static_cast<Chrome *>(context);
+
+    if (phase == TRACE_TEST_BEGIN) {
+        phase = 'B';
+    } else if (phase == TRACE_TEST_END) {
+        phase = 'E';
+    } else {
+        // Do nothing.
+    }
+
+    fprintf(state->stream, "%s{\"name\":", state->separator);
+    quote(name, state->stream);
+    fprintf(state->stream, ",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%d",
+        phase,
+        (unsigned long long)(nanoseconds / 1000),
+        (unsigned long long)(nanoseconds % 1000),
+        pid, tid);
+    if (phase == 'i') {
+        fprintf(state->stream, ",\"s\":\"t\"");
+    }
+    fprintf(state->stream, "}");
+    state->separator = ",\n";
+}
+
+int tracechrome(const char * path, FILE * stream)
+{
+    Chrome state = { stream, "\n" };
+    int rc;
+
+    fprintf(stream, "{\"traceEvents\":[");
+    rc = tracevisit(path, chrome, &state);
+    fprintf(stream, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+    return rc;
+}
+
+}
+}
+}
@@ -12,10 +12,21 @@
 #include <sys/stat.h>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <vector>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
 #include "com/diag/lariat/lariat.h"
+#include "com/diag/lariat/trace.h"
+#include "com/diag/lariat/metrics.h"
+#include "com/diag/lariat/status.h"
+#include "com/diag/lariat/performance.h"
+#include "com/diag/lariat/compare.h"
 
 using namespace std;
 
@@ -168,6 +179,203 @@ TEST(LariatTest, Group) {
 	EXPECT_EQ(group(), 0);
 }
 
+static void traced() {
+	LARIAT_TRACE_SCOPE("traced");
+}
+
+static void counted(void * context, int /* pid */, int /* tid */, char phase, uint64_t /* nanoseconds */, const char * name) {
+	if ((phase == 'E') && (strcmp(name, "traced") == 0)) {
+		++*static_cast<int *>(context);
+	}
+}
+
+TEST(LariatTest, Trace) {
+	ASSERT_NE(tracepath(), (const char *)0);
+	// Two events, each of which should cost tens of nanoseconds.
+	EXPECT_WALLTIME_LE(traced(), 200);
+	int spans = 0;
+	EXPECT_GT(tracevisit(tracepath(), counted, &spans), 0);
+	EXPECT_GE(spans, COM_DIAG_LARIAT_REPETITIONS);
+}
+
+TEST(LariatTest, TraceNameTooLongForAnEventThatDiffersAtTheEndA) {
+}
+
+TEST(LariatTest, TraceNameTooLongForAnEventThatDiffersAtTheEndB) {
+}
+
+static void child() {
+	LARIAT_TRACE_SCOPE("child");
+	exit(0);
+}
+
+TEST(LariatDeathTest, Trace) {
+	EXPECT_EXIT(child(), ::testing::ExitedWithCode(0), ".*");
+}
+
+static void * recorder(void * /* arg */) {
+	for (int ii = 1; ii <= 1000; ++ii) {
+		LARIAT_RECORD("LariatTest.Metrics.latency", ii);
+		LARIAT_COUNTER("LariatTest.Metrics.events");
+	}
+	return 0;
+}
+
+static void * prepared(void * /* arg */) {
+	// Looking the metric up ahead of time claims this thread's shard, so that
+	// even the first value it records neither allocates nor locks.
+	EXPECT_GE(metric("LariatTest.Metrics.latency"), 0);
+	Probe probe(ALLOCS);
+	probe.start();
+	LARIAT_RECORD("LariatTest.Metrics.latency", 1);
+	EXPECT_EQ(probe.stop(), 0U);
+	EXPECT_ALLOCS_LE(LARIAT_RECORD("LariatTest.Metrics.latency", 1), 0);
+	return 0;
+}
+
+TEST(LariatTest, Metrics) {
+	pthread_t thread;
+	ASSERT_EQ(pthread_create(&thread, 0, recorder, 0), 0);
+	recorder(0);
+	EXPECT_EQ(pthread_join(thread, 0), 0);
+	Summary summary;
+	ASSERT_EQ(metricsmerge(metric("LariatTest.Metrics.latency"), &summary), 1);
+	EXPECT_FALSE(summary.counter);
+	EXPECT_EQ(summary.count, 2000U);
+	EXPECT_GE(summary.p50, 500U);
+	EXPECT_LE(summary.p50, 500U * 103 / 100);
+	EXPECT_GE(summary.p99, 990U);
+	EXPECT_LE(summary.p99, 990U * 103 / 100);
+	EXPECT_EQ(summary.maximum, 1000U);
+	ASSERT_EQ(metricsmerge(metric("LariatTest.Metrics.events", true), &summary), 1);
+	EXPECT_TRUE(summary.counter);
+	EXPECT_EQ(summary.count, 2000U);
+	ASSERT_EQ(metricsmerge(metric("LariatTest.Metrics.latency"), &summary), 0);
+	EXPECT_EQ(summary.count, 0U);
+	EXPECT_ALLOCS_LE(LARIAT_RECORD("LariatTest.Metrics.latency", 1), 0);
+	ASSERT_EQ(pthread_create(&thread, 0, prepared, 0), 0);
+	EXPECT_EQ(pthread_join(thread, 0), 0);
+	ASSERT_EQ(metricsmerge(metric("LariatTest.Metrics.latency"), &summary), 1);
+	EXPECT_EQ(summary.count, (1U + COM_DIAG_LARIAT_REPETITIONS) + 1 + (1 + COM_DIAG_LARIAT_REPETITIONS));
+	// Leave these for the surrogate main program to report.
+	recorder(0);
+}
+
+TEST(LariatTest, Status) {
+	char name[sizeof(STATUS_PREFIX) + sizeof("4294967295")];
+	snprintf(name, sizeof(name), "%s%d", STATUS_PREFIX, getpid());
+	Status status;
+	ASSERT_EQ(statusread(name, &status), 0);
+	EXPECT_EQ(status.pid, getpid());
+	EXPECT_EQ(status.sequence % 2, 0U);
+	EXPECT_FALSE(status.finished);
+	EXPECT_GE(status.total, 1U);
+	EXPECT_STREQ(status.test, "LariatTest.Status");
+	EXPECT_GT(status.started, 0U);
+	EXPECT_LE(status.started, monotonic());
+	EXPECT_GT(status.deadline, monotonic());
+	// Give lariat-top time to see this test running.
+	sleep(3);
+}
+
+static void * volatile sink = 0;
+
+static void allocate() {
+	sink = malloc(16);
+	free(sink);
+}
+
+static void sometimes() {
+	static unsigned int calls = 0;
+	if (((calls++) % 8) == 0) {
+		allocate();
+	}
+}
+
+static void spin(long nanoseconds) {
+	struct timespec before;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &before);
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while ((((now.tv_sec - before.tv_sec) * 1000000000L) + (now.tv_nsec - before.tv_nsec)) < nanoseconds);
+}
+
+TEST(LariatTest, Performance) {
+	using namespace std::chrono;
+	EXPECT_WALLTIME_LE(spin(100000), milliseconds(100));
+	EXPECT_NONFATAL_FAILURE(EXPECT_WALLTIME_LE(spin(100000), 1000), "median=");
+	EXPECT_CPU_LE(spin(100000), milliseconds(100));
+	ASSERT_TRUE(Probe(ALLOCS).available());
+	EXPECT_ALLOCS_LE((void)0, 0);
+	EXPECT_ALLOCS_LE(allocate(), 1);
+	EXPECT_ALLOCS_LE(delete new int, 1);
+	EXPECT_NONFATAL_FAILURE(EXPECT_ALLOCS_LE(allocate(), 0), "allocs of allocate()");
+	EXPECT_NONFATAL_FAILURE(EXPECT_ALLOCS_LE(sometimes(), 0), "Actual: max=1");
+	// Perf events are often not permitted (e.g. in containers), in which case
+	// these must mark the test skipped rather than quietly pass.
+	bool measurable = Probe(SYSCALLS).available() && Probe(INSTRUCTIONS).available();
+	if (measurable) {
+		EXPECT_NONFATAL_FAILURE(EXPECT_SYSCALLS_LE(getppid(), 0), "Actual: max=");
+	}
+	EXPECT_SYSCALLS_LE(getppid(), 1);
+	EXPECT_INSTRUCTIONS_LE((void)0, 100);
+	// The statement runs even where its cost cannot be measured.
+	int runs = 0;
+	EXPECT_SYSCALLS_LE(++runs, 1);
+	EXPECT_EQ(runs, measurable ? (1 + COM_DIAG_LARIAT_REPETITIONS) : 1);
+#if defined(GTEST_SKIP)
+	EXPECT_EQ(IsSkipped(), !measurable);
+#endif
+}
+
+TEST(LariatTest, Compare) {
+	static const uint64_t SLOW[] = { 200, 210, 190, 205, 195, 220, 180, 200, 201, 199 };
+	static const uint64_t FAST[] = { 100, 105, 95, 102, 98, 110, 90, 100, 101, 99 };
+	Comparison comparison;
+	EXPECT_LT(compare(SLOW, 1, FAST, 10, &comparison), 0);
+	ASSERT_EQ(compare(SLOW, 10, FAST, 10, &comparison), 0);
+	EXPECT_NEAR(comparison.speedup, 2.0, 0.05);
+	EXPECT_LT(comparison.lower, comparison.speedup);
+	EXPECT_GT(comparison.upper, comparison.speedup);
+	EXPECT_GT(comparison.lower, 1.0);
+	EXPECT_LT(comparison.p, 0.001);
+	ASSERT_EQ(compare(FAST, 10, SLOW, 10, &comparison), 0);
+	EXPECT_NEAR(comparison.speedup, 0.5, 0.05);
+	EXPECT_LT(comparison.upper, 1.0);
+	ASSERT_EQ(compare(SLOW, 10, SLOW, 10, &comparison), 0);
+	EXPECT_DOUBLE_EQ(comparison.speedup, 1.0);
+	EXPECT_LT(comparison.lower, 1.0);
+	EXPECT_GT(comparison.upper, 1.0);
+	EXPECT_GT(comparison.p, 0.9);
+	// For ten timings each at 95% confidence the Mann-Whitney table rejects
+	// U <= 23, so the interval runs from the 24th smallest to the 24th largest
+	// of the hundred pairwise ratios, which these primes make all distinct.
+	static const uint64_t A[] = { 101, 103, 107, 109, 113, 127, 131, 137, 139, 149 };
+	static const uint64_t B[] = { 53, 59, 61, 67, 71, 73, 79, 83, 89, 97 };
+	std::vector<double> ratios;
+	for (int ii = 0; ii < 10; ++ii) {
+		for (int jj = 0; jj < 10; ++jj) {
+			ratios.push_back((double)A[ii] / B[jj]);
+		}
+	}
+	std::sort(ratios.begin(), ratios.end());
+	ASSERT_EQ(compare(A, 10, B, 10, &comparison, 0.95), 0);
+	EXPECT_DOUBLE_EQ(comparison.lower, ratios[23]);
+	EXPECT_DOUBLE_EQ(comparison.upper, ratios[76]);
+}
+
+class LariatSuiteTest : public ::testing::Test {
+public:
+	static void SetUpTestCase() {
+		// This span nests just as deeply as the tests, but is not one.
+		LARIAT_TRACE_SCOPE("LariatSuiteTest.SetUpTestCase");
+	}
+};
+
+TEST_F(LariatSuiteTest, Compare) {
+}
+
 } } } }
 
 int main(int argc, char ** argv, char ** envp)